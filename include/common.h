@@ -55,6 +55,8 @@ enum ins_opcode_t
 	READ,  // Write data to a byte on memory
 	WRITE, // Read data from a byte on memory
 	SYSCALL,
+	LOOP,  // Run instructions [arg_1]..LOOP [arg_0] times in total
+	JNZ,   // Jump to instruction [arg_1] if register [arg_0] is not zero
 };
 
 /* instructions executed by the CPU */
@@ -65,6 +67,7 @@ struct inst_t
 	arg_t arg_1;
 	arg_t arg_2;
 	arg_t arg_3;
+	/* LOOP keeps its running iteration count in arg_2 */
 };
 
 struct code_seg_t
@@ -4,6 +4,12 @@
 
 #include "common.h"
 
+/*
+ * Index of the simulated CPU the calling thread runs, a negative
+ * TRACE_CPU_* id on the kernel threads
+ */
+extern __thread int cpu_id;
+
 /* Execute an instruction of a process. Return 0
  * if the instruction is executed successfully.
  * Otherwise, return 1. */
@@ -21,3 +21,17 @@ int liballoc(struct pcb_t *, addr_t, uint32_t);
 int libfree(struct pcb_t *, uint32_t);
 int libread(struct pcb_t*, uint32_t, addr_t, uint32_t*);
 int libwrite(struct pcb_t*, BYTE, uint32_t, addr_t);
+int libexit(struct pcb_t*);
+int libfork(struct pcb_t*, struct pcb_t*);
+void libswitch(struct pcb_t*, int);
+int pg_getpage(struct mm_struct *, int, addr_t *, struct pcb_t *);
+void pg_fault_report(void);
+void pg_reclaim_counters(unsigned long *, unsigned long *);
+void kswapd_start(struct memphy_struct *);
+void kswapd_stop(void);
+void ksm_start(struct memphy_struct *);
+void ksm_stop(void);
+int ksm_scan(struct memphy_struct *, int);
+
+extern int swap_ra_max;
+extern int ksm_pages_to_scan, ksm_sleep_ms;
@@ -5,5 +5,14 @@
 
 struct pcb_t * load(const char * path);
 
+/*
+ * Copy [parent] into a new PCB under a new pid, with its own code
+ * segment. The kernel state and the address space are up to the caller.
+ */
+struct pcb_t * dup_proc(const struct pcb_t * parent);
+
+/* Release the PCB and code segment built by load() */
+void unload(struct pcb_t * proc);
+
 #endif
 
@@ -0,0 +1,27 @@
+/*
+ * Asynchronous kernel log
+ *
+ * Every thread formats its messages into a private lock-free ring and a
+ * background writer drains the rings to stdout in the order the messages
+ * were issued, so the output is byte-for-byte what printf would produce
+ * without the simulated CPUs contending on the stdio lock.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+#define LOG_RING_SLOTS 1024	/* records per thread ring, power of 2 */
+#define LOG_LINE_MAX 240	/* longest message kept per record */
+
+/* Same contract as printf. Falls back to printf until log_start() */
+int log_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Start the writer thread, messages are buffered from then on */
+void log_start(void);
+
+/* Drain every ring, stop the writer and go back to printf */
+void log_stop(void);
+
+#endif
@@ -13,8 +13,34 @@
 #define PAGING_MEMSWPSZ BIT(29)
 #define PAGING_SWPFPN_OFFSET 5  
 #define PAGING_MAX_PGN  (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH),PAGING_PAGESZ))
+#define PAGING_SWAP_RA_MAX 8  /* largest swap readahead window, in pages */
+#define PAGING_ZSWAP_PERCENT 20  /* compressed pool size, in percent of RAM */
+#define PAGING_SWPTYP_ZSWAP 31   /* swap type of pages held by the pool */
+#define PAGING_WMARK_LOW 4       /* kswapd wakes below this percent of RAM free */
+#define PAGING_WMARK_HIGH 8      /* and evicts until this percent is free */
+#define PAGING_KSM_PAGES 64      /* frames ksmd looks at per wakeup */
+#define PAGING_KSM_SLEEP_MS 5    /* ksmd sleeps this long between scans */
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
+#ifdef MM64
+/*
+ * 64-bit PTE
+ *   63 present, 62 swapped, 61 readahead, 60 dirty, 59 accessed, 58 huge
+ *   57     copy-on-write
+ *   56..45 usrnum
+ *   39..0  FPN             (present)
+ *   44..5  swap offset     (swapped)
+ *    4..0  swap type       (swapped)
+ */
+#define PAGING_PTE_PRESENT_MASK BIT_ULL(63)
+#define PAGING_PTE_SWAPPED_MASK BIT_ULL(62)
+#define PAGING_PTE_RESERVE_MASK BIT_ULL(61)
+#define PAGING_PTE_DIRTY_MASK BIT_ULL(60)
+#define PAGING_PTE_ACCESSED_MASK BIT_ULL(59)
+#define PAGING_PTE_HUGE_MASK BIT_ULL(58) /* PMD maps 512 frames */
+#define PAGING_PTE_COW_MASK BIT_ULL(57)  /* frame shared by fork or ksm, copied on write */
+#define PAGING_PTE_READAHEAD_MASK PAGING_PTE_RESERVE_MASK /* swapped in ahead, not used yet */
+#else
 /* PTE BIT */
 #define PAGING_PTE_PRESENT_MASK BIT(31) 
 #define PAGING_PTE_SWAPPED_MASK BIT(30)
@@ -22,11 +48,27 @@
 #define PAGING_PTE_DIRTY_MASK BIT(28)
 #define PAGING_PTE_EMPTY01_MASK BIT(14)
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
+#endif
 
 /* PTE BIT PRESENT */
 #define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
 #define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
 
+#ifdef MM64
+#define PAGING_PTE_USRNUM_LOBIT 45
+#define PAGING_PTE_USRNUM_HIBIT 56
+#define PAGING_PTE_FPN_LOBIT 0
+#define PAGING_PTE_FPN_HIBIT 39
+#define PAGING_PTE_SWPTYP_LOBIT 0
+#define PAGING_PTE_SWPTYP_HIBIT 4
+#define PAGING_PTE_SWPOFF_LOBIT 5
+#define PAGING_PTE_SWPOFF_HIBIT 44
+
+#define PAGING_PTE_USRNUM_MASK GENMASK_ULL(PAGING_PTE_USRNUM_HIBIT,PAGING_PTE_USRNUM_LOBIT)
+#define PAGING_PTE_FPN_MASK    GENMASK_ULL(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
+#define PAGING_PTE_SWPTYP_MASK GENMASK_ULL(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
+#define PAGING_PTE_SWPOFF_MASK GENMASK_ULL(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#else
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
 #define PAGING_PTE_USRNUM_HIBIT 27
@@ -45,12 +87,14 @@
 #define PAGING_PTE_FPN_MASK    GENMASK(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWPTYP_MASK GENMASK(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
 #define PAGING_PTE_SWPOFF_MASK GENMASK(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#endif
 
 /* Extract PTE */
 #define PAGING_PTE_OFFST(pte) GETVAL(pte,PAGING_OFFST_MASK,PAGING_ADDR_OFFST_LOBIT)
 #define PAGING_PTE_PGN(pte)   GETVAL(pte,PAGING_PGN_MASK,PAGING_ADDR_PGN_LOBIT)
 #define PAGING_PTE_FPN(pte)   GETVAL(pte,PAGING_PTE_FPN_MASK,PAGING_PTE_FPN_LOBIT)
 #define PAGING_PTE_SWP(pte)   GETVAL(pte,PAGING_PTE_SWPOFF_MASK,PAGING_SWPFPN_OFFSET)
+#define PAGING_PTE_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
 
 /* OFFSET */
 #define PAGING_ADDR_OFFST_LOBIT 0
@@ -115,9 +159,9 @@ int get_pd_from_address(addr_t addr, addr_t* pgd, addr_t* p4d, addr_t* pud, addr
 int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_t* pmd, addr_t* pt);
 int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn);
 int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff);
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val);
-int init_pte(addr_t *pte,
+pte_t pte_get_entry(struct pcb_t *caller, addr_t pgn);
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, pte_t pte_val);
+int init_pte(pte_t *pte,
              int pre,    // present
              addr_t fpn,    // FPN
              int drt,    // dirty
@@ -129,6 +173,7 @@ int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, addr_t offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int free_mm(struct mm_struct *mm, struct pcb_t *caller);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -148,16 +193,28 @@ struct vm_rg_struct * get_symrg_byid(struct mm_struct* mm, int rgid);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, addr_t vmastart, addr_t vmaend);
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz);
-int find_victim_page(struct mm_struct* mm, addr_t *pgn);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *fpn);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nfp, addr_t *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn);
+int MEMPHY_count_freefp(struct memphy_struct *mp);
+int MEMPHY_get_zerofp(struct memphy_struct *mp, addr_t *fpn);
+int MEMPHY_put_zerofp(struct memphy_struct *mp);
+int MEMPHY_is_zerofp(struct memphy_struct *mp, addr_t fpn);
 int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data);
 int MEMPHY_dump(struct memphy_struct * mp);
+int MEMPHY_read_page(struct memphy_struct *mp, addr_t fpn, BYTE *buf);
+int MEMPHY_write_page(struct memphy_struct *mp, addr_t fpn, const BYTE *buf);
+int MEMPHY_copy_page(struct memphy_struct *mpsrc, addr_t srcfpn,
+                     struct memphy_struct *mpdst, addr_t dstfpn);
+int MEMPHY_zero_page(struct memphy_struct *mp, addr_t fpn);
 int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg,
+                     const char *path, int keep);
+void free_memphy(struct memphy_struct *mp);
 
 /* print list */
 int print_list_fp(struct framephy_struct *fp);
@@ -56,9 +56,16 @@
 #define PAGING64_PUD_ENTRIES  512  
 #define PAGING64_PMD_ENTRIES  512
 #define PAGING64_PT_ENTRIES   512
+#define PAGING64_HUGE_PAGESZ  (PAGING64_PAGESZ * PAGING64_PT_ENTRIES) /* 2MB PMD mapping */
 #define PAGING64_PTE_PRESENT(pte)    ((pte) & PAGING_PTE_PRESENT_MASK)
 #define PAGING64_PTE_SWAPPED(pte)    ((pte) & PAGING_PTE_SWAPPED_MASK)
 addr_t *fpn_to_ptr(struct memphy_struct *mp, addr_t fpn);
+int pmd_map_huge(struct pcb_t *caller, addr_t pgn, addr_t *fpn);
+int pte_set_flags(struct pcb_t *caller, addr_t pgn, pte_t bits);
+int pte_clear_flags(struct pcb_t *caller, addr_t pgn, pte_t bits);
+int pte_map_range(struct pcb_t *caller, addr_t pgn, int pgnum,
+                  struct framephy_struct *frames);
+addr_t pgtbl_footprint(struct mm_struct *mm, int *frames);
 /* Masks */
 #define PAGING64_ADDR_OFFST_MASK  GENMASK64(PAGING_ADDR_OFFST_HIBIT,PAGING_ADDR_OFFST_LOBIT)
 #define PAGING64_ADDR_PT_MASK  GENMASK64(PAGING64_ADDR_PT_HIBIT,PAGING64_ADDR_PT_LOBIT)
@@ -20,6 +20,14 @@
 //#define MMDBG 1
 #define IODUMP 1
 //#define PAGETBL_DUMP 1
+#define LOG_ASYNC 1
+#define MM_TLB 1
+#define MM64_HUGEPAGE 1
+#define MM64_FOLD 1
+#define MM_SWAP_RA 1
+#define MM_ZSWAP 1
+#define MM_KSWAPD 1
+#define MM_KSM 1
 
 /* 
  * @bksysnet:
@@ -26,12 +26,15 @@
 
 #ifdef MM64
 #define ADDR_TYPE uint64_t
+#define PTE_TYPE uint64_t
 #else
 #define ADDR_TYPE uint32_t
+#define PTE_TYPE uint32_t
 #endif
 
 typedef char BYTE;
 typedef ADDR_TYPE addr_t;
+typedef PTE_TYPE pte_t;
 typedef unsigned int uint32_t;
 
 
@@ -82,18 +85,37 @@ struct vm_area_struct {
    struct vm_area_struct *vm_next;
 };
 
+/*
+ * Page walk cache entry, the PT page covering a 2MB region or the PMD
+ * entry of a huge mapping
+ */
+#define MM64_PWC_ENTRIES 8 /* power of 2 */
+
+struct pwc_entry {
+   addr_t tag;    /* pgn >> 9, the PGD..PMD indexes of the region */
+   pte_t *pt;
+   int huge;      /* pt is the huge PMD entry itself */
+};
+
 /* 
  * Memory management struct
  */
 struct mm_struct {
 #ifdef MM64
-   uint64_t *pgd;
-   uint64_t *p4d;
-   uint64_t *pud;
-   uint64_t *pmd;
-   uint64_t *pt;
+   /*
+    * Root table in host memory, the lower levels live in RAM frames. The
+    * root stands for level [top] (0 = PGD .. 4 = PT) as long as every
+    * mapped page has zero indexes above it, small address spaces skip
+    * the upper levels that way.
+    */
+   pte_t *pgd;
+   int top;
+   int pgtbl_frames;    /* RAM frames holding tables below the root */
+
+   /* Upper level walks of recently used 2MB regions */
+   struct pwc_entry pwc[MM64_PWC_ENTRIES];
 #else
-   uint32_t *pgd;
+   pte_t *pgd;
 #endif
 
    struct vm_area_struct *mmap;
@@ -101,8 +123,26 @@ struct mm_struct {
    /* Currently we support a fixed number of symbol */
    struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
 
-   /* list of free page */
-   struct pgn_t *fifo_pgn;
+   /* CPU running the owner, -1 while it waits */
+   int oncpu;
+   int inflight;        /* inside an access made without mmvm_lock */
+
+   /* Address space id tagging this mm's TLB entries */
+   uint32_t asid;
+
+   /* Faults served from a new frame and from swap */
+   unsigned long minflt;
+   unsigned long majflt;
+   unsigned long swapout;   /* pages of this mm written to swap */
+   unsigned long cowflt;    /* pages copied on write after a fork */
+
+   /* Swap readahead window, sized from the hits since the last major fault */
+   int ra_win;
+   addr_t ra_prev;          /* page of the last major fault */
+   unsigned long ra_recent;
+   unsigned long ra_pages;  /* read ahead, used before eviction, evicted unused */
+   unsigned long ra_hits;
+   unsigned long ra_wasted;
 };
 
 /*
@@ -125,9 +165,18 @@ struct memphy_struct {
    int rdmflg;
    int cursor;
 
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
-   struct framephy_struct *used_fp_list;
+   /* Management structure, one bit per frame, set while it is in use */
+   unsigned long *fp_bitmap;
+   unsigned long *fp_full; /* one bit per fp_bitmap word, set when it is full */
+   int fp_words;        /* words of fp_bitmap */
+   int fp_hint;         /* fp_full word the next search starts at */
+   int free_cnt;        /* clear bits of fp_bitmap */
+
+   int mapped;          /* storage is a host file mapped by init_memphy_file */
+
+   /* Shared zero frame, marked in use while zero_refs > 0 */
+   addr_t zero_fpn;
+   int zero_refs;
 };
 
 #endif
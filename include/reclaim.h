@@ -0,0 +1,82 @@
+/*
+ * Page reclaim
+ *
+ * Every RAM frame holding a swappable user page has an entry in the
+ * frame table naming the owner and the page it backs. Resident frames
+ * are linked through the table in the order their pages came in, so
+ * tracking a page costs no allocation and a victim is found at the head
+ * of that list. The replacement policies differ only in how they pick
+ * that victim and are chosen per run by name.
+ */
+
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+#include "common.h"
+
+enum reclaim_policy {
+	RECLAIM_FIFO,		/* oldest page first */
+	RECLAIM_CLOCK,		/* second chance for recently accessed pages */
+	RECLAIM_2Q,		/* inactive and active lists, LRU-2 like */
+	RECLAIM_WS,		/* pages idle beyond the working set window */
+	RECLAIM_NR_POLICIES
+};
+
+extern int reclaim_policy;
+
+/* Select the policy called [name] ("fifo", "clock", ...), -1 if unknown */
+int reclaim_set_policy(const char *name);
+
+const char *reclaim_policy_name(int policy);
+
+/* Size the frame table for a RAM of [nframes], dropping what it held */
+void reclaim_init(int nframes);
+
+/* Page [pgn] of [owner] now lives in frame [fpn] */
+void reclaim_track(struct pcb_t *owner, addr_t fpn, addr_t pgn);
+
+/* [owner] maps the tracked frame [fpn] at [pgn] as well, after a fork or merge */
+void reclaim_share(addr_t fpn, struct pcb_t *owner, addr_t pgn);
+
+/*
+ * [owner] no longer maps frame [fpn]. Returns the mappings left, the
+ * frame stops being tracked at 0 and may be freed. An untracked frame
+ * gives 0 as well.
+ */
+int reclaim_unmap(addr_t fpn, struct pcb_t *owner);
+
+/* Processes mapping frame [fpn], 0 when it is not tracked */
+int reclaim_mapcount(addr_t fpn);
+
+/*
+ * Fill [owner] and [pgn] with the mappings of frame [fpn], the owner
+ * first. Returns their number, the arrays are left alone when it is
+ * above [max].
+ */
+int reclaim_maps(addr_t fpn, struct pcb_t **owner, addr_t *pgn, int max);
+
+/*
+ * Pick a frame to evict for [caller] and stop tracking it. Frames mapped
+ * by a process running on another CPU are passed over, unless [caller]
+ * is NULL for kswapd with the CPUs stopped. Called with the mm lock
+ * held, returns -1 when nothing can be evicted.
+ */
+int reclaim_victim(struct pcb_t *caller, struct pcb_t **owner,
+		   addr_t *pgn, addr_t *fpn);
+
+/*
+ * The process on [cpu] is leaving it, frames passed over because it was
+ * running may be evicted again
+ */
+void reclaim_unpark(int cpu);
+
+/*
+ * Take the next other mapper off a shared victim [fpn], -1 when none is
+ * left. Mappers not taken off come back with reclaim_track().
+ */
+int reclaim_pop_map(addr_t fpn, struct pcb_t **owner, addr_t *pgn);
+
+/* Print the policy in use and the victim search counters */
+void reclaim_report(void);
+
+#endif
@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -22,6 +22,12 @@ void put_proc(struct pcb_t * proc);
 
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
+
+/* Check the ready queue still has room for a new process */
+int can_add_proc(struct pcb_t * proc);
+
+/* Drop a finished process from the running list */
+void finish_proc(struct pcb_t * proc);
 void finish_scheduler(void);
 #endif
 
@@ -0,0 +1,40 @@
+/*
+ * Swap devices
+ *
+ * Every configured MEMSWP of non-zero size takes swap slots. Devices
+ * are filled in priority order, highest first, and slots of devices
+ * sharing a priority are handed out round robin so their I/O is striped
+ * across them. A swapped out PTE names its device by swap type.
+ */
+
+#ifndef SWAPDEV_H
+#define SWAPDEV_H
+
+#include "common.h"
+
+/*
+ * Use the [n] devices of [mswp] with priorities [prio], NULL for all
+ * equal. Devices too small for a page are left out.
+ */
+void swapdev_init(struct memphy_struct *mswp, const int *prio, int n);
+
+/* Take a free slot, -1 when every device is full */
+int swapdev_get_slot(int *type, addr_t *off);
+
+/* Drop a swap entry naming slot [off] of device [type], the last frees it */
+void swapdev_put_slot(int type, addr_t off);
+
+/* One more swap entry names slot [off] of device [type] */
+void swapdev_dup_slot(int type, addr_t off);
+
+/* Copy RAM frame [fpn] of [mram] out to a slot and back, counting the I/O */
+int swapdev_write(int type, addr_t off, struct memphy_struct *mram, addr_t fpn);
+int swapdev_read(int type, addr_t off, struct memphy_struct *mram, addr_t fpn);
+
+/* Pages read from and written to device [type], -1 when it is not in use */
+int swapdev_io(int type, unsigned long *reads, unsigned long *writes);
+
+/* Print size, use and I/O of every device */
+void swapdev_report(void);
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * Per-CPU software TLB
+ *
+ * Each simulated CPU caches leaf PTEs of present pages in a small set
+ * associative TLB tagged by the address space id of the mm, so entries
+ * of different processes live side by side and a context switch needs no
+ * flush. Any change to a PTE shoots the page down on every CPU.
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+#include "common.h"
+#include <stdint.h>
+
+#define TLB_SETS 16		/* power of 2 */
+#define TLB_WAYS 4
+
+/* Create one TLB per simulated CPU */
+void tlb_init(int ncpus);
+
+/* Look [pgn] up in the calling CPU's TLB, 0 on hit with the PTE in [pte] */
+int tlb_lookup(uint32_t asid, addr_t pgn, pte_t *pte);
+
+/* Cache the PTE of a present page after a miss */
+void tlb_fill(uint32_t asid, addr_t pgn, pte_t pte);
+
+/* Drop [pgn] of [asid] from every CPU */
+void tlb_shootdown(uint32_t asid, addr_t pgn);
+
+/* Drop every entry of [asid] from every CPU */
+void tlb_flush_asid(uint32_t asid);
+
+/* Print hit and miss counters of every CPU */
+void tlb_report(void);
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Binary event trace
+ *
+ * Kernel events are recorded as fixed size records into per-thread
+ * buffers and appended to a trace file, trace2json turns the file
+ * into Chrome trace JSON for chrome://tracing or ui.perfetto.dev.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "SOSTRACE"
+#define TRACE_VERSION 1
+#define TRACE_BUF_RECS 4096	/* records buffered per thread */
+
+enum trace_type {
+	TRACE_LOAD,		/* arg0 = prio */
+	TRACE_DISPATCH,
+	TRACE_PREEMPT,
+	TRACE_FINISH,
+	TRACE_ALLOC,		/* arg0 = size, arg1 = address */
+	TRACE_FREE,		/* arg0 = region id */
+	TRACE_FAULT,		/* arg0 = pgn, arg1 = fpn */
+	TRACE_SWAPOUT,		/* arg0 = ram fpn, arg1 = swap fpn */
+	TRACE_SWAPIN,		/* arg0 = ram fpn, arg1 = swap fpn */
+	TRACE_SYSCALL,		/* arg0 = nr */
+	TRACE_NR_TYPES
+};
+
+struct trace_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;
+};
+
+/* cpu of records made by the kernel threads, CPUs count from 0 */
+enum {
+	TRACE_CPU_LOADER = -1,
+	TRACE_CPU_KSWAPD = -2,
+	TRACE_CPU_KSMD = -3,
+	TRACE_NR_KTHREADS = 3
+};
+
+struct trace_rec {
+	uint32_t slot;		/* time slot the event happened in */
+	uint8_t type;
+	int8_t cpu;		/* CPU index or a TRACE_CPU_* kernel thread */
+	uint16_t rsvd;
+	uint32_t pid;
+	uint32_t arg0;
+	uint64_t arg1;
+};
+
+/* Read by every thread without a lock, use __atomic accesses */
+extern int trace_on;
+
+#define TRACE(type, pid, arg0, arg1) \
+	do { \
+		if (__atomic_load_n(&trace_on, __ATOMIC_ACQUIRE)) \
+			trace_event(type, pid, arg0, arg1); \
+	} while (0)
+
+/* Start recording into [path], returns -1 if it cannot be created */
+int trace_start(const char *path);
+
+void trace_event(int type, uint32_t pid, uint32_t arg0, uint64_t arg1);
+
+/* Flush every buffer and close the file, recording threads must be done */
+void trace_stop(void);
+
+#endif
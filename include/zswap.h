@@ -0,0 +1,44 @@
+/*
+ * Compressed swap pool
+ *
+ * Evicted pages are compressed into a pool of host memory sized as a
+ * fraction of RAM before they would be copied to a swap device. A page
+ * filled with one byte value is kept as that byte alone. Pages held by
+ * the pool are swapped out with type PAGING_SWPTYP_ZSWAP and the pool
+ * handle as offset, the device only sees the pages the pool rejects.
+ */
+
+#ifndef ZSWAP_H
+#define ZSWAP_H
+
+#include "common.h"
+
+/*
+ * Size the pool to [poolsz] bytes of compressed data, 0 turns it off.
+ * The counters start over.
+ */
+void zswap_init(addr_t poolsz);
+
+/*
+ * Keep a copy of the PAGING_PAGESZ bytes at [page], returning its handle
+ * in [handle]. -1 when the pool is full or the page does not compress
+ * well, it has to go to a swap device then.
+ */
+int zswap_store(const BYTE *page, addr_t *handle);
+
+/* Restore the page held under [handle] into [page], the entry stays */
+int zswap_load(addr_t handle, BYTE *page);
+
+/* Drop a reference to the entry [handle], the last one frees it */
+void zswap_invalidate(addr_t handle);
+
+/* Take one more reference to the entry [handle] */
+void zswap_dup(addr_t handle);
+
+/* Pages stored and loaded so far, and the ratio of the compressed ones */
+void zswap_counters(unsigned long *stored, unsigned long *loads, double *ratio);
+
+/* Print the pool use, the compression ratio and the swap I/O avoided */
+void zswap_report(void);
+
+#endif
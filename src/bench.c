@@ -0,0 +1,1682 @@
+/*
+ * Micro benchmarks for the simulator kernel
+ *
+ *   bench <name> [options]
+ *
+ * Each benchmark links against the kernel objects and drives one
+ * subsystem directly, printing a before/after style table on stderr so
+ * stdout may be pointed at /dev/null for the logging cases.
+ */
+
+#include "log.h"
+#include "mm64.h"
+#include "libmem.h"
+#include "reclaim.h"
+#include "zswap.h"
+#include "swapdev.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ * log - cost of a page table dump line seen from a simulated CPU
+ */
+struct log_args {
+	int lines;
+	int async;
+	unsigned long ns;	/* time spent inside the producer calls */
+};
+
+static void *log_worker(void *arg)
+{
+	struct log_args *a = arg;
+	unsigned long start = now_ns();
+	int i;
+
+	for (i = 0; i < a->lines; i++) {
+		/* Same shape as print_pgtbl */
+		if (a->async)
+			log_printf("%08ld: %08x\n", (long)i * 4096, 0x80000000u | i);
+		else
+			printf("%08ld: %08x\n", (long)i * 4096, 0x80000000u | i);
+	}
+	a->ns = now_ns() - start;
+	return NULL;
+}
+
+static void log_run(int threads, int lines, int async)
+{
+	pthread_t *tid = malloc(threads * sizeof(pthread_t));
+	struct log_args *args = calloc(threads, sizeof(struct log_args));
+	unsigned long start, wall, busy = 0;
+	int i;
+
+	if (async)
+		log_start();
+
+	start = now_ns();
+	for (i = 0; i < threads; i++) {
+		args[i].lines = lines;
+		args[i].async = async;
+		pthread_create(&tid[i], NULL, log_worker, &args[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(tid[i], NULL);
+		busy += args[i].ns;
+	}
+	if (async)
+		log_stop();
+	else
+		fflush(stdout);
+	wall = now_ns() - start;
+
+	fprintf(stderr, "%-8s %7d %9d %12.1f %10.2f\n",
+		async ? "async" : "printf", threads, lines,
+		(double)busy / ((double)threads * lines), wall / 1e6);
+
+	free(tid);
+	free(args);
+}
+
+static int bench_log(int argc, char *argv[])
+{
+	int threads = 4, lines = 200000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'n':
+			lines = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench log [-t threads] [-n lines]\n");
+			return 1;
+		}
+	}
+	if (threads <= 0 || lines <= 0)
+		return 1;
+
+	fprintf(stderr, "%-8s %7s %9s %12s %10s\n",
+		"mode", "threads", "lines", "ns/line", "wall ms");
+	log_run(threads, lines, 0);
+	log_run(threads, lines, 1);
+	return 0;
+}
+
+/* A process with an empty mm over a RAM of [ramsz] bytes */
+static struct pcb_t *bench_proc(addr_t ramsz)
+{
+	struct pcb_t *proc = calloc(1, sizeof(struct pcb_t));
+
+	proc->pid = 1;
+	proc->krnl = calloc(1, sizeof(struct krnl_t));
+	proc->krnl->mram = malloc(sizeof(struct memphy_struct));
+	proc->krnl->mm = malloc(sizeof(struct mm_struct));
+	init_memphy(proc->krnl->mram, ramsz, 1);
+	reclaim_init(ramsz / PAGING_PAGESZ);
+	init_mm(proc->krnl->mm, proc);
+	return proc;
+}
+
+/* A process [pid] on the RAM and swap of [proc], without an mm yet */
+static struct pcb_t *bench_peer(struct pcb_t *proc, int pid)
+{
+	struct pcb_t *p = calloc(1, sizeof(struct pcb_t));
+
+	p->pid = pid;
+	p->krnl = malloc(sizeof(struct krnl_t));
+	*p->krnl = *proc->krnl;
+	p->krnl->mm = NULL;
+	return p;
+}
+
+/* [ndev] swap devices of [slots] pages between them, [prio] as swapdev_init() */
+static void bench_swap_devs(struct pcb_t *proc, int slots, int ndev, const int *prio)
+{
+	struct memphy_struct *mswp = calloc(ndev, sizeof(struct memphy_struct));
+	int i;
+
+	for (i = 0; i < ndev; i++)
+		init_memphy(&mswp[i], (addr_t)(slots / ndev) * PAGING_PAGESZ, 1);
+	swapdev_init(mswp, prio, ndev);
+	proc->krnl->active_mswp = &mswp[0];
+}
+
+/*
+ * walk - translation cost with and without the page walk cache
+ */
+static int bench_walk(int argc, char *argv[])
+{
+	int pages = PAGING_MAX_PGN, rounds = 2000;
+	struct pcb_t *proc;
+	unsigned long start, ns, sum = 0;
+	int opt, cached, r, pgn;
+
+	while ((opt = getopt(argc, argv, "p:r:")) != -1) {
+		switch (opt) {
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench walk [-p pages] [-r rounds]\n");
+			return 1;
+		}
+	}
+	if (pages <= 0 || rounds <= 0)
+		return 1;
+
+	proc = bench_proc((addr_t)(pages + 64) * PAGING_PAGESZ);
+	for (pgn = 0; pgn < pages; pgn++)
+		pte_set_fpn(proc, pgn, pgn + 16);
+
+	fprintf(stderr, "%-8s %7s %7s %10s\n", "walk", "pages", "rounds", "ns/lookup");
+	for (cached = 0; cached <= 1; cached++) {
+		start = now_ns();
+		for (r = 0; r < rounds; r++) {
+			for (pgn = 0; pgn < pages; pgn++) {
+				/* Forget the upper levels to time a full walk */
+				if (!cached)
+					proc->krnl->mm->pwc[(pgn >> 9) & (MM64_PWC_ENTRIES - 1)].pt = NULL;
+				sum += pte_get_entry(proc, pgn);
+			}
+		}
+		ns = now_ns() - start;
+		fprintf(stderr, "%-8s %7d %7d %10.1f\n", cached ? "pwc" : "full",
+			pages, rounds, (double)ns / ((double)pages * rounds));
+	}
+
+	return sum == 0;
+}
+
+#ifdef MM64_HUGEPAGE
+/* Time [rounds] passes of translations over pages 1..[pages]-1 */
+static double lookup_ns(struct pcb_t *proc, int pages, int rounds, int cached)
+{
+	unsigned long start = now_ns(), sum = 0;
+	int r, pgn;
+
+	for (r = 0; r < rounds; r++) {
+		for (pgn = 1; pgn < pages; pgn++) {
+			if (!cached)
+				proc->krnl->mm->pwc[(pgn >> 9) & (MM64_PWC_ENTRIES - 1)].pt = NULL;
+			sum += pte_get_entry(proc, pgn);
+		}
+	}
+	if (sum == 0)
+		fprintf(stderr, "nothing mapped\n");
+	return (double)(now_ns() - start) / ((double)(pages - 1) * rounds);
+}
+
+/*
+ * huge - page table footprint and walk cost of a 4MB heap mapped with
+ * 4KB pages against 2MB PMD mappings
+ */
+static int bench_huge(int argc, char *argv[])
+{
+	int pages = PAGING_MAX_PGN, rounds = 2000;
+	struct pcb_t *proc;
+	addr_t addr, fpn, tfpn;
+	int opt, huge, pgn, used, data;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		switch (opt) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench huge [-r rounds]\n");
+			return 1;
+		}
+	}
+	if (rounds <= 0)
+		return 1;
+
+	fprintf(stderr, "%-6s %6s %6s %6s %8s %10s %10s\n", "map", "pages",
+		"data", "tables", "levels", "full ns", "pwc ns");
+	for (huge = 0; huge <= 1; huge++) {
+		proc = bench_proc(2 * (addr_t)pages * PAGING_PAGESZ);
+		__alloc(proc, 0, 0, (addr_t)(pages - 1) * PAGING_PAGESZ, &addr);
+		used = MEMPHY_count_freefp(proc->krnl->mram);
+
+		/* Fault every heap page in, as pg_getpage() would */
+		for (pgn = 1; pgn < pages; pgn++) {
+			if (huge) {
+				pg_getpage(proc->krnl->mm, pgn, &tfpn, proc);
+			} else {
+				MEMPHY_get_freefp(proc->krnl->mram, &fpn);
+				pte_set_fpn(proc, pgn, fpn);
+				reclaim_track(proc, fpn, pgn);
+			}
+		}
+		used -= MEMPHY_count_freefp(proc->krnl->mram);
+		data = huge ? pages : pages - 1;
+
+		fprintf(stderr, "%-6s %6d %6d %6d %8d %10.1f %10.1f\n",
+			huge ? "2MB" : "4KB", pages - 1, data, used - data,
+			(huge ? 4 : 5) - proc->krnl->mm->top,
+			lookup_ns(proc, pages, rounds, 0),
+			lookup_ns(proc, pages, rounds, 1));
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * map - mapping a run of pages one pte_set_fpn() at a time against
+ * pte_map_range() filling each PT page after a single walk
+ */
+static int bench_map(int argc, char *argv[])
+{
+	int pages = 100000, rounds = 5;
+	struct framephy_struct *frames;
+	struct pcb_t *proc;
+	unsigned long start, ns[2] = { 0, 0 };
+	addr_t ramsz;
+	int opt, range, r, i, tables = 0;
+
+	while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+		switch (opt) {
+		case 'n':
+			pages = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench map [-n pages] [-r rounds]\n");
+			return 1;
+		}
+	}
+	if (pages <= 0 || rounds <= 0)
+		return 1;
+
+	/* The data frames are never touched, RAM only has to hold the tables */
+	frames = calloc(pages, sizeof(struct framephy_struct));
+	for (i = 0; i < pages; i++) {
+		frames[i].fpn = i + 1;
+		frames[i].fp_next = (i + 1 < pages) ? &frames[i + 1] : NULL;
+	}
+	ramsz = (addr_t)(pages / PAGING64_PT_ENTRIES + 16) * PAGING_PAGESZ;
+
+	for (r = 0; r < rounds; r++) {
+		for (range = 0; range <= 1; range++) {
+			proc = bench_proc(ramsz);
+			tables = MEMPHY_count_freefp(proc->krnl->mram);
+			start = now_ns();
+			if (range) {
+				if (pte_map_range(proc, 0, pages, frames) != pages)
+					fprintf(stderr, "short mapping\n");
+			} else {
+				for (i = 0; i < pages; i++)
+					pte_set_fpn(proc, i, frames[i].fpn);
+			}
+			ns[range] += now_ns() - start;
+			tables -= MEMPHY_count_freefp(proc->krnl->mram);
+		}
+	}
+
+	fprintf(stderr, "%-10s %8s %7s %7s %10s\n", "map", "pages", "rounds",
+		"tables", "ns/page");
+	for (range = 0; range <= 1; range++)
+		fprintf(stderr, "%-10s %8d %7d %7d %10.1f\n",
+			range ? "range" : "per-page", pages, rounds, tables,
+			(double)ns[range] / ((double)pages * rounds));
+
+	free(frames);
+	return 0;
+}
+
+#ifdef MM64_FOLD
+/*
+ * pgtbl - page table memory of small and sparse address spaces with the
+ * root folded onto the lowest level needed against a full 5 level tree
+ */
+static int bench_pgtbl(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		addr_t pgn[4];		/* single pages, or a run when [1] is 0 */
+		int run;
+	} shapes[] = {
+		{ "1 page", { 1 }, 1 },
+		{ "1MB", { 0 }, 256 },
+		{ "4MB", { 0 }, 1024 },
+		{ "sparse", { 1, 1UL << 18, 1UL << 27, 1UL << 36 }, 0 },
+	};
+	struct pcb_t *proc;
+	addr_t host;
+	int s, fold, i, frames;
+
+	(void)argc;
+	(void)argv;
+	fprintf(stderr, "%-8s %-6s %7s %10s %7s %11s\n", "space", "root",
+		"levels", "host B", "frames", "frame B");
+	for (s = 0; s < (int)(sizeof(shapes) / sizeof(shapes[0])); s++) {
+		for (fold = 0; fold <= 1; fold++) {
+			proc = bench_proc(64 * PAGING_PAGESZ);
+			if (!fold)
+				proc->krnl->mm->top = 0;
+			if (shapes[s].run > 0) {
+				for (i = 0; i < shapes[s].run; i++)
+					pte_set_fpn(proc, shapes[s].pgn[0] + i, i + 1);
+			} else {
+				for (i = 0; i < 4; i++)
+					pte_set_fpn(proc, shapes[s].pgn[i], i + 1);
+			}
+			host = pgtbl_footprint(proc->krnl->mm, &frames);
+			fprintf(stderr, "%-8s %-6s %7d %10lu %7d %11d\n",
+				shapes[s].name, fold ? "folded" : "PGD",
+				5 - proc->krnl->mm->top, (unsigned long)host,
+				frames, frames * PAGING_PAGESZ);
+			free_mm(proc->krnl->mm, proc);
+		}
+	}
+
+	return 0;
+}
+#endif
+
+#ifdef MM_SWAP_RA
+/*
+ * swap - a heap larger than RAM written and read back in rounds, every
+ * page is checked after it has been through swap. Runs without and with
+ * swap readahead, reading back in page order or, with -x, at random.
+ */
+static int bench_swap(int argc, char *argv[])
+{
+	int frames = 64, pages = 512, rounds = 4, shuffle = 0;
+	int windows[2] = { 1, PAGING_SWAP_RA_MAX };
+	struct pcb_t *proc;
+	struct mm_struct *mm;
+	unsigned long start, ns;
+	addr_t addr;
+	BYTE data;
+	int opt, w, r, i, pgn, bad = 0;
+
+	while ((opt = getopt(argc, argv, "f:p:r:w:x")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'w':
+			windows[1] = atoi(optarg);
+			break;
+		case 'x':
+			shuffle = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: bench swap [-f frames] [-p pages] [-r rounds] "
+				"[-w readahead pages] [-x]\n");
+			return 1;
+		}
+	}
+	if (frames <= 8 || pages <= 0 || pages >= PAGING_MAX_PGN || rounds <= 0 ||
+	    windows[1] < 1)
+		return 1;
+
+	fprintf(stderr, "%7s %7s %7s %7s %8s %8s %8s %8s %8s %7s %10s\n", "frames",
+		"pages", "rounds", "window", "minflt", "majflt", "ra", "ra used",
+		"ra waste", "bad", "ns/access");
+	for (w = 0; w < 2; w++) {
+		swap_ra_max = windows[w];
+		proc = bench_proc((addr_t)frames * PAGING_PAGESZ);
+		mm = proc->krnl->mm;
+		bench_swap_devs(proc, pages * 2, 1, NULL);
+		__alloc(proc, 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+
+		srand(1);
+		start = now_ns();
+		for (r = 0; r < rounds; r++) {
+			for (pgn = 0; pgn < pages; pgn++)
+				__write(proc, 0, 0, (addr_t)pgn * PAGING_PAGESZ, (BYTE)(pgn + r));
+			for (i = 0; i < pages; i++) {
+				pgn = shuffle ? rand() % pages : i;
+				if (__read(proc, 0, 0, (addr_t)pgn * PAGING_PAGESZ, &data) != 0 ||
+				    data != (BYTE)(pgn + r))
+					bad++;
+			}
+		}
+		ns = now_ns() - start;
+
+		fprintf(stderr, "%7d %7d %7d %7d %8lu %8lu %8lu %8lu %8lu %7d %10.1f\n",
+			frames, pages, rounds, swap_ra_max, mm->minflt, mm->majflt,
+			mm->ra_pages, mm->ra_hits, mm->ra_wasted, bad,
+			(double)ns / (2.0 * pages * rounds));
+	}
+
+	return bad != 0;
+}
+#endif
+
+/*
+ * reclaim - the same access strings replayed under every replacement
+ * policy, counting faults and swap traffic
+ */
+enum { WL_HOTSCAN, WL_LOOP, WL_RANDOM, WL_PHASES, NR_WL };
+
+static const char *wl_names[NR_WL] = {
+	[WL_HOTSCAN] = "hotscan",	/* 70% on a small hot set, the rest scans */
+	[WL_LOOP] = "loop",		/* cyclic pass a quarter larger than RAM */
+	[WL_RANDOM] = "random",		/* uniform over twice the RAM */
+	[WL_PHASES] = "phases",		/* a working set that moves now and then */
+};
+
+/* Pages touched by workload [wl] on a RAM of [frames] */
+static int wl_pages(int wl, int frames)
+{
+	switch (wl) {
+	case WL_HOTSCAN:
+		return frames / 2 + 8 * frames;
+	case WL_LOOP:
+		return frames + frames / 4;
+	case WL_RANDOM:
+		return 2 * frames;
+	default:
+		return 4 * (frames * 3 / 4);
+	}
+}
+
+/* Page of the [i]th access, [scan] carries the sequential position */
+static int wl_next(int wl, int frames, int i, int *scan)
+{
+	int hot = frames / 2, set = frames * 3 / 4;
+
+	switch (wl) {
+	case WL_HOTSCAN:
+		if (rand() % 10 < 7)
+			return rand() % hot;
+		*scan = (*scan + 1) % (8 * frames);
+		return hot + *scan;
+	case WL_LOOP:
+		*scan = (*scan + 1) % wl_pages(wl, frames);
+		return *scan;
+	case WL_RANDOM:
+		return rand() % wl_pages(wl, frames);
+	default:
+		return (i / 2500) % 4 * set + rand() % set;
+	}
+}
+
+static int bench_reclaim(int argc, char *argv[])
+{
+	int frames = 64, accesses = 20000, only_wl = -1, only_policy = -1;
+	struct pcb_t *proc;
+	struct mm_struct *mm;
+	unsigned long start, ns;
+	addr_t addr;
+	BYTE data;
+	int opt, wl, policy, pages, i, pgn, scan;
+
+	while ((opt = getopt(argc, argv, "f:n:w:p:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'n':
+			accesses = atoi(optarg);
+			break;
+		case 'w':
+			for (wl = 0; wl < NR_WL; wl++)
+				if (strcmp(optarg, wl_names[wl]) == 0)
+					only_wl = wl;
+			if (only_wl < 0)
+				goto usage;
+			break;
+		case 'p':
+			if (reclaim_set_policy(optarg) != 0)
+				goto usage;
+			only_policy = reclaim_policy;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (frames < 16 || accesses <= 0 ||
+	    wl_pages(WL_HOTSCAN, frames) >= PAGING_MAX_PGN)
+		return 1;
+
+	fprintf(stderr, "%-8s %-6s %6s %6s %8s %8s %8s %8s %10s\n", "workload",
+		"policy", "frames", "pages", "fault %", "minflt", "swapin",
+		"swapout", "ns/access");
+	for (wl = 0; wl < NR_WL; wl++) {
+		if (only_wl >= 0 && wl != only_wl)
+			continue;
+		pages = wl_pages(wl, frames);
+
+		for (policy = 0; policy < RECLAIM_NR_POLICIES; policy++) {
+			if (only_policy >= 0 && policy != only_policy)
+				continue;
+			reclaim_policy = policy;
+			proc = bench_proc((addr_t)frames * PAGING_PAGESZ);
+			mm = proc->krnl->mm;
+			bench_swap_devs(proc, pages * 2, 1, NULL);
+			__alloc(proc, 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+
+			/* Every policy sees the same string, one access in four writes */
+			srand(1);
+			scan = -1;
+			start = now_ns();
+			for (i = 0; i < accesses; i++) {
+				pgn = wl_next(wl, frames, i, &scan);
+				addr = (addr_t)pgn * PAGING_PAGESZ;
+				if (i % 4 == 0)
+					__write(proc, 0, 0, addr, (BYTE)i);
+				else
+					__read(proc, 0, 0, addr, &data);
+			}
+			ns = now_ns() - start;
+
+			fprintf(stderr, "%-8s %-6s %6d %6d %8.2f %8lu %8lu %8lu %10.1f\n",
+				wl_names[wl], reclaim_policy_name(policy), frames,
+				pages, 100.0 * (mm->minflt + mm->majflt) / accesses,
+				mm->minflt, mm->majflt, mm->swapout,
+				(double)ns / accesses);
+		}
+	}
+
+	return 0;
+
+usage:
+	fprintf(stderr, "Usage: bench reclaim [-f frames] [-n accesses] "
+		"[-w hotscan|loop|random|phases] [-p fifo|clock|2q|ws]\n");
+	return 1;
+}
+
+#ifdef MM_ZSWAP
+/*
+ * zswap - a heap of zero, same-filled, text-like and random pages larger
+ * than RAM, read back in rounds with and without the compressed pool
+ */
+static void zswap_fill(int pgn, BYTE *page)
+{
+	static const char *words[] = { "page ", "frame ", "swap ", "fault ",
+				       "table ", "entry ", "process ", "cpu " };
+	uint32_t seed = pgn * 2654435761u + 1;
+	int i, n;
+
+	switch (pgn % 4) {
+	case 0:
+		memset(page, 0, PAGING_PAGESZ);
+		break;
+	case 1:
+		memset(page, pgn | 1, PAGING_PAGESZ);
+		break;
+	case 2:
+		for (i = 0; i < PAGING_PAGESZ; i += n) {
+			seed = seed * 1103515245 + 12345;
+			n = strlen(words[(seed >> 16) % 8]);
+			if (n > PAGING_PAGESZ - i)
+				n = PAGING_PAGESZ - i;
+			memcpy(page + i, words[(seed >> 16) % 8], n);
+		}
+		break;
+	default:
+		for (i = 0; i < PAGING_PAGESZ; i++) {
+			seed = seed * 1103515245 + 12345;
+			page[i] = seed >> 24;
+		}
+	}
+}
+
+static int bench_zswap(int argc, char *argv[])
+{
+	int frames = 64, pages = 512, rounds = 4, percent = PAGING_ZSWAP_PERCENT;
+	BYTE expect[PAGING_PAGESZ];
+	struct pcb_t *proc;
+	struct mm_struct *mm;
+	unsigned long start, ns, stored, loads;
+	double ratio;
+	addr_t addr, fpn;
+	int opt, on, r, pgn, bad = 0;
+
+	while ((opt = getopt(argc, argv, "f:p:r:z:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'z':
+			percent = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench zswap [-f frames] [-p pages] [-r rounds] "
+				"[-z pool percent of RAM]\n");
+			return 1;
+		}
+	}
+	if (frames <= 8 || pages <= 0 || pages >= PAGING_MAX_PGN || rounds <= 0 ||
+	    percent <= 0)
+		return 1;
+
+	fprintf(stderr, "%-5s %7s %7s %8s %8s %8s %8s %8s %6s %7s %10s\n", "pool",
+		"frames", "pages", "swapin", "swapout", "dev rd", "dev wr",
+		"pooled", "ratio", "bad", "ns/access");
+	for (on = 0; on <= 1; on++) {
+		zswap_init(on ? (addr_t)frames * PAGING_PAGESZ / 100 * percent : 0);
+		proc = bench_proc((addr_t)frames * PAGING_PAGESZ);
+		mm = proc->krnl->mm;
+		bench_swap_devs(proc, pages * 2, 1, NULL);
+		__alloc(proc, 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+
+		start = now_ns();
+		for (pgn = 0; pgn < pages; pgn++) {
+			/* A write fault, a read would map the shared zero frame */
+			__write(proc, 0, 0, (addr_t)pgn * PAGING_PAGESZ, 0);
+			pg_getpage(mm, pgn, &fpn, proc);
+			zswap_fill(pgn, proc->krnl->mram->storage + fpn * PAGING_PAGESZ);
+		}
+		for (r = 0; r < rounds; r++) {
+			for (pgn = 0; pgn < pages; pgn++) {
+				zswap_fill(pgn, expect);
+				if (pg_getpage(mm, pgn, &fpn, proc) != 0 ||
+				    memcmp(proc->krnl->mram->storage + fpn * PAGING_PAGESZ,
+					   expect, PAGING_PAGESZ) != 0)
+					bad++;
+			}
+		}
+		ns = now_ns() - start;
+		zswap_counters(&stored, &loads, &ratio);
+
+		fprintf(stderr, "%-5s %7d %7d %8lu %8lu %8lu %8lu %8lu %6.2f %7d %10.1f\n",
+			on ? "on" : "off", frames, pages, mm->majflt + mm->ra_pages,
+			mm->swapout, mm->majflt + mm->ra_pages - loads,
+			mm->swapout - stored, stored, ratio, bad,
+			(double)ns / ((double)pages * (rounds + 1)));
+	}
+
+	return bad != 0;
+}
+#endif
+
+/*
+ * swapdev - the swap traffic of one heap spread over one, two and four
+ * devices of equal priority, then over two priority levels too small to
+ * hold it alone
+ */
+static int bench_swapdev(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		int ndev;
+		int prio[PAGING_MAX_MMSWP];
+	} setups[] = {
+		{ "1 dev", 1, { 0 } },
+		{ "2 dev", 2, { 0, 0 } },
+		{ "4 dev", 4, { 0, 0, 0, 0 } },
+		{ "4 prio", 4, { 1, 1, 0, 0 } },
+	};
+	int frames = 64, pages = 512, rounds = 2;
+	unsigned long start, ns, rd, wr;
+	struct pcb_t *proc;
+	addr_t addr;
+	BYTE data;
+	int opt, s, r, pgn, dev;
+	char io[PAGING_MAX_MMSWP][24];
+
+	while ((opt = getopt(argc, argv, "f:p:r:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench swapdev [-f frames] [-p pages] [-r rounds]\n");
+			return 1;
+		}
+	}
+	if (frames <= 8 || pages <= frames || pages >= PAGING_MAX_PGN || rounds <= 0)
+		return 1;
+
+	fprintf(stderr, "%-7s %-14s %-14s %-14s %-14s %10s\n", "swap",
+		"dev 0 rd/wr", "dev 1 rd/wr", "dev 2 rd/wr", "dev 3 rd/wr",
+		"ns/access");
+	for (s = 0; s < (int)(sizeof(setups) / sizeof(setups[0])); s++) {
+		proc = bench_proc((addr_t)frames * PAGING_PAGESZ);
+		/* Half again the heap, a priority pair holds three quarters of it */
+		bench_swap_devs(proc, pages + pages / 2, setups[s].ndev, setups[s].prio);
+		__alloc(proc, 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+
+		start = now_ns();
+		for (r = 0; r < rounds; r++) {
+			for (pgn = 0; pgn < pages; pgn++)
+				__write(proc, 0, 0, (addr_t)pgn * PAGING_PAGESZ, (BYTE)pgn);
+			for (pgn = 0; pgn < pages; pgn++)
+				__read(proc, 0, 0, (addr_t)pgn * PAGING_PAGESZ, &data);
+		}
+		ns = now_ns() - start;
+
+		for (dev = 0; dev < PAGING_MAX_MMSWP; dev++) {
+			if (swapdev_io(dev, &rd, &wr) == 0)
+				snprintf(io[dev], sizeof(io[dev]), "%lu/%lu", rd, wr);
+			else
+				snprintf(io[dev], sizeof(io[dev]), "-");
+		}
+		fprintf(stderr, "%-7s %-14s %-14s %-14s %-14s %10.1f\n", setups[s].name,
+			io[0], io[1], io[2], io[3],
+			(double)ns / (2.0 * pages * rounds));
+	}
+
+	return 0;
+}
+
+#ifdef MM_KSWAPD
+/*
+ * kswapd - processes sharing one RAM take turns on a CPU, each touching
+ * its whole heap in a slice, without and with background reclaim. The
+ * CPU idles for a time slot after each access, as the os CPUs wait for
+ * the timer, and only the time inside the accesses is counted. With
+ * kswapd on, pages are evicted in those gaps rather than by the faults.
+ */
+static int kswapd_access(struct pcb_t *p, int pgn, BYTE value, int write,
+			 const struct timespec *slot, unsigned long *ns)
+{
+	unsigned long start = now_ns();
+	BYTE data;
+	int ret;
+
+	if (write)
+		ret = __write(p, 0, 0, (addr_t)pgn * PAGING_PAGESZ, value);
+	else
+		ret = __read(p, 0, 0, (addr_t)pgn * PAGING_PAGESZ, &data);
+	*ns += now_ns() - start;
+	nanosleep(slot, NULL);
+	return ret != 0 || (!write && data != value);
+}
+
+static int bench_kswapd(int argc, char *argv[])
+{
+	int frames = 64, nproc = 4, pages = 48, rounds = 4, slot_us = 50;
+	struct pcb_t **procs;
+	struct pcb_t *p;
+	struct timespec slot;
+	unsigned long ns, direct, background, d0, b0, majflt;
+	addr_t addr;
+	int opt, on, i, r, pgn, bad;
+
+	while ((opt = getopt(argc, argv, "f:n:p:r:s:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'n':
+			nproc = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 's':
+			slot_us = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench kswapd [-f frames] [-n processes] "
+				"[-p pages each] [-r rounds] [-s idle us per access]\n");
+			return 1;
+		}
+	}
+	if (frames <= 8 || nproc <= 0 || pages <= 0 || pages >= PAGING_MAX_PGN ||
+	    rounds <= 0 || slot_us < 0)
+		return 1;
+	slot.tv_sec = slot_us / 1000000;
+	slot.tv_nsec = slot_us % 1000000 * 1000L;
+
+	procs = calloc(nproc, sizeof(struct pcb_t *));
+	fprintf(stderr, "%7s %7s %7s %7s %8s %8s %8s %7s %10s\n", "kswapd",
+		"frames", "procs", "pages", "majflt", "direct", "kswapd", "bad",
+		"ns/access");
+	for (on = 0; on < 2; on++) {
+		procs[0] = bench_proc((addr_t)frames * PAGING_PAGESZ);
+		bench_swap_devs(procs[0], nproc * pages * 2, 1, NULL);
+		for (i = 1; i < nproc; i++) {
+			p = bench_peer(procs[0], i + 1);
+			p->krnl->mm = malloc(sizeof(struct mm_struct));
+			init_mm(p->krnl->mm, p);
+			procs[i] = p;
+		}
+		for (i = 0; i < nproc; i++)
+			__alloc(procs[i], 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+		if (on)
+			kswapd_start(procs[0]->krnl->mram);
+
+		bad = 0;
+		ns = 0;
+		pg_reclaim_counters(&d0, &b0);
+		for (r = 0; r < rounds; r++) {
+			for (i = 0; i < nproc; i++) {
+				p = procs[i];
+				libswitch(p, 0);
+				for (pgn = 0; pgn < pages; pgn++)
+					bad += kswapd_access(p, pgn, (BYTE)(pgn + i + r), 1,
+							     &slot, &ns);
+				for (pgn = 0; pgn < pages; pgn++)
+					bad += kswapd_access(p, pgn, (BYTE)(pgn + i + r), 0,
+							     &slot, &ns);
+				libswitch(p, -1);
+			}
+		}
+		if (on)
+			kswapd_stop();
+		pg_reclaim_counters(&direct, &background);
+
+		majflt = 0;
+		for (i = 0; i < nproc; i++)
+			majflt += procs[i]->krnl->mm->majflt;
+		fprintf(stderr, "%7s %7d %7d %7d %8lu %8lu %8lu %7d %10.1f\n",
+			on ? "on" : "off", frames, nproc, pages, majflt, direct - d0,
+			background - b0, bad,
+			(double)ns / (2.0 * nproc * pages * rounds));
+		if (bad != 0)
+			return 1;
+	}
+
+	return 0;
+}
+#endif
+
+/* [wpct] of every 100 pages are rewritten, spread evenly */
+static int fork_written(int pgn, int wpct)
+{
+	return (pgn % 100) * wpct / 100 != (pgn % 100 + 1) * wpct / 100;
+}
+
+/*
+ * fork - workers with the same heap, each loaded and filled on its own
+ * against forked from one filled parent. Every worker then reads its
+ * whole heap and rewrites a share of it, the forked ones copy only the
+ * pages they write.
+ */
+static int bench_fork(int argc, char *argv[])
+{
+	int frames = 1024, nproc = 8, pages = 64, wpct = 10;
+	struct pcb_t **procs;
+	struct memphy_struct *mram;
+	unsigned long start, ns, cow;
+	addr_t addr;
+	BYTE data, want;
+	int opt, forked, i, pgn, bad, used;
+
+	while ((opt = getopt(argc, argv, "f:n:p:w:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'n':
+			nproc = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'w':
+			wpct = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench fork [-f frames] [-n workers] "
+				"[-p pages each] [-w percent of pages written]\n");
+			return 1;
+		}
+	}
+	if (frames <= 8 || nproc <= 0 || pages <= 0 || pages >= PAGING_MAX_PGN ||
+	    wpct < 0 || wpct > 100)
+		return 1;
+
+	procs = calloc(nproc, sizeof(struct pcb_t *));
+	fprintf(stderr, "%-6s %7s %7s %7s %8s %8s %7s %10s\n", "start", "procs",
+		"pages", "write%", "frames", "cow", "bad", "us total");
+	for (forked = 0; forked < 2; forked++) {
+		procs[0] = bench_proc((addr_t)frames * PAGING_PAGESZ);
+		bench_swap_devs(procs[0], nproc * pages * 2, 1, NULL);
+		mram = procs[0]->krnl->mram;
+		bad = 0;
+
+		start = now_ns();
+		for (i = 0; i < nproc; i++) {
+			if (i > 0 && forked) {
+				procs[i] = bench_peer(procs[0], i + 1);
+				if (libfork(procs[0], procs[i]) != 0)
+					return 1;
+				continue;
+			}
+			if (i > 0) {
+				procs[i] = bench_peer(procs[0], i + 1);
+				procs[i]->krnl->mm = malloc(sizeof(struct mm_struct));
+				init_mm(procs[i]->krnl->mm, procs[i]);
+			}
+			__alloc(procs[i], 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+			for (pgn = 0; pgn < pages; pgn++)
+				__write(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ, (BYTE)pgn);
+		}
+
+		/* The workers read everything and write every few pages */
+		for (i = 0; i < nproc; i++) {
+			for (pgn = 0; pgn < pages; pgn++) {
+				if (__read(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ, &data) != 0 ||
+				    data != (BYTE)pgn)
+					bad++;
+				if (fork_written(pgn, wpct))
+					__write(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ, (BYTE)(pgn + i + 1));
+			}
+		}
+		ns = now_ns() - start;
+
+		/* Each must see its own writes and the untouched pages of the parent */
+		for (i = 0; i < nproc; i++) {
+			for (pgn = 0; pgn < pages; pgn++) {
+				want = fork_written(pgn, wpct) ? (BYTE)(pgn + i + 1) : (BYTE)pgn;
+				if (__read(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ, &data) != 0 ||
+				    data != want)
+					bad++;
+			}
+		}
+
+		used = frames - MEMPHY_count_freefp(mram);
+		cow = 0;
+		for (i = 0; i < nproc; i++)
+			cow += procs[i]->krnl->mm->cowflt;
+		fprintf(stderr, "%-6s %7d %7d %7d %8d %8lu %7d %10.1f\n",
+			forked ? "fork" : "load", nproc, pages, wpct, used, cow, bad,
+			ns / 1000.0);
+
+		for (i = 0; i < nproc; i++)
+			libexit(procs[i]);
+		if (MEMPHY_count_freefp(mram) != frames) {
+			fprintf(stderr, "%d frames left after exit\n",
+				frames - MEMPHY_count_freefp(mram));
+			bad++;
+		}
+		if (bad != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * zero - workers reading a sparse heap and writing a share of it, with
+ * every page written first for reference. Pages only read stay on the
+ * zero frame, and RAM left dirty by earlier users must read back as 0.
+ */
+static int bench_zero(int argc, char *argv[])
+{
+	int frames = 1024, nproc = 8, pages = 64, wpct = 10;
+	struct pcb_t **procs;
+	struct memphy_struct *mram;
+	unsigned long start, ns, minflt;
+	addr_t addr;
+	BYTE data, want;
+	int opt, sparse, i, pgn, bad, used;
+
+	while ((opt = getopt(argc, argv, "f:n:p:w:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'n':
+			nproc = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'w':
+			wpct = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench zero [-f frames] [-n workers] "
+				"[-p pages each] [-w percent of pages written]\n");
+			return 1;
+		}
+	}
+	if (frames <= 8 || nproc <= 0 || pages <= 0 || pages >= PAGING_MAX_PGN ||
+	    wpct < 0 || wpct > 100)
+		return 1;
+
+	procs = calloc(nproc, sizeof(struct pcb_t *));
+	fprintf(stderr, "%-6s %7s %7s %7s %8s %8s %7s %10s\n", "first", "procs",
+		"pages", "write%", "frames", "minflt", "bad", "us total");
+	for (sparse = 0; sparse < 2; sparse++) {
+		procs[0] = bench_proc((addr_t)frames * PAGING_PAGESZ);
+		bench_swap_devs(procs[0], nproc * pages * 2, 1, NULL);
+		mram = procs[0]->krnl->mram;
+		/* Left over from earlier processes */
+		memset(mram->storage, 0x5a, mram->maxsz);
+		for (i = 1; i < nproc; i++) {
+			procs[i] = bench_peer(procs[0], i + 1);
+			procs[i]->krnl->mm = malloc(sizeof(struct mm_struct));
+			init_mm(procs[i]->krnl->mm, procs[i]);
+		}
+		bad = 0;
+
+		start = now_ns();
+		for (i = 0; i < nproc; i++) {
+			__alloc(procs[i], 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+			for (pgn = 0; pgn < pages; pgn++) {
+				addr = (addr_t)pgn * PAGING_PAGESZ;
+				if (!sparse)
+					__write(procs[i], 0, 0, addr, 0);
+				if (__read(procs[i], 0, 0, addr + 1, &data) != 0 || data != 0)
+					bad++;
+				if (fork_written(pgn, wpct))
+					__write(procs[i], 0, 0, addr, (BYTE)(pgn + 1));
+			}
+		}
+		ns = now_ns() - start;
+
+		for (i = 0; i < nproc; i++) {
+			for (pgn = 0; pgn < pages; pgn++) {
+				want = fork_written(pgn, wpct) ? (BYTE)(pgn + 1) : 0;
+				if (__read(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ, &data) != 0 ||
+				    data != want)
+					bad++;
+			}
+		}
+
+		used = frames - MEMPHY_count_freefp(mram);
+		minflt = 0;
+		for (i = 0; i < nproc; i++)
+			minflt += procs[i]->krnl->mm->minflt;
+		fprintf(stderr, "%-6s %7d %7d %7d %8d %8lu %7d %10.1f\n",
+			sparse ? "read" : "write", nproc, pages, wpct, used, minflt,
+			bad, ns / 1000.0);
+
+		for (i = 0; i < nproc; i++)
+			libexit(procs[i]);
+		if (MEMPHY_count_freefp(mram) != frames) {
+			fprintf(stderr, "%d frames left after exit\n",
+				frames - MEMPHY_count_freefp(mram));
+			bad++;
+		}
+		if (bad != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* The page copy swapping used before the block operations */
+static void copy_bytewise(struct memphy_struct *src, addr_t srcfpn,
+			  struct memphy_struct *dst, addr_t dstfpn)
+{
+	BYTE data;
+	int i;
+
+	for (i = 0; i < PAGING_PAGESZ; i++) {
+		MEMPHY_read(src, srcfpn * PAGING_PAGESZ + i, &data);
+		MEMPHY_write(dst, dstfpn * PAGING_PAGESZ + i, data);
+	}
+}
+
+/*
+ * pgcopy - page copies per second between RAM and a swap device, one
+ * byte at a time through MEMPHY_read/MEMPHY_write against the page
+ * operations, and page clears.
+ */
+static int bench_pgcopy(int argc, char *argv[])
+{
+	int frames = 256, rounds = 20;
+	struct memphy_struct ram, swp;
+	unsigned long start, ns;
+	BYTE buf[PAGING_PAGESZ];
+	addr_t fpn;
+	int opt, r, block, bad = 0;
+
+	while ((opt = getopt(argc, argv, "f:r:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench pgcopy [-f frames] [-r rounds]\n");
+			return 1;
+		}
+	}
+	if (frames <= 0 || rounds <= 0)
+		return 1;
+
+	init_memphy(&ram, (addr_t)frames * PAGING_PAGESZ, 1);
+	init_memphy(&swp, (addr_t)frames * PAGING_PAGESZ, 1);
+	for (fpn = 0; fpn < (addr_t)frames; fpn++)
+		memset(ram.storage + fpn * PAGING_PAGESZ, (int)fpn, PAGING_PAGESZ);
+
+	fprintf(stderr, "%-10s %-9s %8s %14s %10s\n", "op", "method", "pages",
+		"pages/s", "ns/page");
+	for (block = 0; block < 2; block++) {
+		/* Out to swap and back, as swap_out_page() and a major fault */
+		memset(swp.storage, 0, swp.maxsz);
+		start = now_ns();
+		for (r = 0; r < rounds; r++) {
+			for (fpn = 0; fpn < (addr_t)frames; fpn++) {
+				if (block)
+					MEMPHY_copy_page(&ram, fpn, &swp, frames - 1 - fpn);
+				else
+					copy_bytewise(&ram, fpn, &swp, frames - 1 - fpn);
+			}
+		}
+		ns = now_ns() - start;
+		for (fpn = 0; fpn < (addr_t)frames; fpn++) {
+			MEMPHY_read_page(&swp, frames - 1 - fpn, buf);
+			if (buf[0] != (BYTE)fpn || buf[PAGING_PAGESZ - 1] != (BYTE)fpn)
+				bad++;
+		}
+		fprintf(stderr, "%-10s %-9s %8d %14.0f %10.1f\n", "ram->swap",
+			block ? "page" : "bytewise", frames * rounds,
+			frames * rounds / (ns / 1e9), (double)ns / (frames * rounds));
+	}
+
+	start = now_ns();
+	for (r = 0; r < rounds; r++)
+		for (fpn = 0; fpn < (addr_t)frames; fpn++)
+			MEMPHY_zero_page(&swp, fpn);
+	ns = now_ns() - start;
+	for (fpn = 0; fpn < (addr_t)frames; fpn++) {
+		MEMPHY_read_page(&swp, fpn, buf);
+		if (buf[0] != 0 || buf[PAGING_PAGESZ - 1] != 0)
+			bad++;
+	}
+	fprintf(stderr, "%-10s %-9s %8d %14.0f %10.1f\n", "zero", "page",
+		frames * rounds, frames * rounds / (ns / 1e9),
+		(double)ns / (frames * rounds));
+
+	free_memphy(&ram);
+	free_memphy(&swp);
+	if (bad != 0) {
+		fprintf(stderr, "%d pages copied wrong\n", bad);
+		return 1;
+	}
+	return 0;
+}
+
+/* Resident set of the bench, in KB */
+static long rss_kb(void)
+{
+	FILE *f = fopen("/proc/self/statm", "r");
+	long size, resident = 0;
+
+	if (f != NULL) {
+		if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+			resident = 0;
+		fclose(f);
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*
+ * memphy - host memory held by a swap device of PAGING_MEMSWPSZ on the
+ * heap and on a mapped file, once created and after a share of its
+ * pages was written. A kept file is left in the directory.
+ */
+static int bench_memphy(int argc, char *argv[])
+{
+	const char *dir = "/tmp";
+	int pct = 10, keep = 0;
+	struct memphy_struct mp;
+	unsigned long start, ns_init, ns_write;
+	long rss0, rss_init, rss_used;
+	char path[256];
+	addr_t pgn, npages;
+	BYTE data;
+	int opt, file, bad;
+
+	while ((opt = getopt(argc, argv, "d:kp:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		case 'p':
+			pct = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench memphy [-d file dir] [-k keep the file] "
+				"[-p percent of pages written]\n");
+			return 1;
+		}
+	}
+	if (pct < 0 || pct > 100)
+		return 1;
+
+	npages = PAGING_MEMSWPSZ / PAGING_PAGESZ;
+	snprintf(path, sizeof(path), "%s/swap0", dir);
+	fprintf(stderr, "%-7s %10s %8s %10s %10s %10s %10s\n", "storage", "MB",
+		"write%", "init us", "write us", "rss init", "rss used");
+	for (file = 0; file < 2; file++) {
+		rss0 = rss_kb();
+		start = now_ns();
+		if (!file)
+			init_memphy(&mp, PAGING_MEMSWPSZ, 1);
+		else if (init_memphy_file(&mp, PAGING_MEMSWPSZ, 1, path, keep) != 0) {
+			perror(path);
+			return 1;
+		}
+		ns_init = now_ns() - start;
+		rss_init = rss_kb() - rss0;
+
+		start = now_ns();
+		for (pgn = 0; pgn < npages * pct / 100; pgn++)
+			MEMPHY_write(&mp, pgn * PAGING_PAGESZ, (BYTE)pgn);
+		ns_write = now_ns() - start;
+		rss_used = rss_kb() - rss0;
+
+		bad = 0;
+		for (pgn = 0; pgn < npages * pct / 100; pgn++)
+			if (MEMPHY_read(&mp, pgn * PAGING_PAGESZ, &data) != 0 ||
+			    data != (BYTE)pgn)
+				bad++;
+
+		fprintf(stderr, "%-7s %10lu %8d %10.1f %10.1f %8ldKB %8ldKB\n",
+			file ? "file" : "heap", (unsigned long)PAGING_MEMSWPSZ >> 20,
+			pct, ns_init / 1000.0, ns_write / 1000.0, rss_init, rss_used);
+		free_memphy(&mp);
+		if (bad != 0)
+			return 1;
+	}
+	if (keep)
+		fprintf(stderr, "device contents kept in %s\n", path);
+
+	return 0;
+}
+
+#ifdef MM_KSM
+/* Byte 1 of a page, 0 on the pages every worker fills alike */
+static BYTE ksm_tag(int i, int pgn, int spct)
+{
+	return fork_written(pgn, spct) ? 0 : (BYTE)(i + 1);
+}
+
+/*
+ * ksm - workers filling a share of their heap alike, scanned by the
+ * merger pass by pass. The frames in use drop to one per identical
+ * page once a page has held still for a pass, and the pages rewritten
+ * afterwards get their own frames back.
+ */
+static int bench_ksm(int argc, char *argv[])
+{
+	int frames = 1024, nproc = 8, pages = 64, spct = 75, wpct = 10;
+	struct pcb_t **procs;
+	struct memphy_struct *mram;
+	unsigned long start, ns, cow;
+	addr_t addr;
+	BYTE data, want, tag;
+	int opt, i, pgn, bad = 0, merged = 0, pass;
+
+	while ((opt = getopt(argc, argv, "f:n:p:s:w:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'n':
+			nproc = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 's':
+			spct = atoi(optarg);
+			break;
+		case 'w':
+			wpct = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench ksm [-f frames] [-n workers] "
+				"[-p pages each] [-s percent of pages alike] "
+				"[-w percent of pages written]\n");
+			return 1;
+		}
+	}
+	if (frames <= 8 || nproc <= 0 || pages <= 0 || pages >= PAGING_MAX_PGN ||
+	    spct < 0 || spct > 100 || wpct < 0 || wpct > 100)
+		return 1;
+
+	procs = calloc(nproc, sizeof(struct pcb_t *));
+	procs[0] = bench_proc((addr_t)frames * PAGING_PAGESZ);
+	bench_swap_devs(procs[0], nproc * pages * 2, 1, NULL);
+	mram = procs[0]->krnl->mram;
+	start = now_ns();
+	for (i = 0; i < nproc; i++) {
+		if (i > 0) {
+			procs[i] = bench_peer(procs[0], i + 1);
+			procs[i]->krnl->mm = malloc(sizeof(struct mm_struct));
+			init_mm(procs[i]->krnl->mm, procs[i]);
+		}
+		__alloc(procs[i], 0, 0, (addr_t)pages * PAGING_PAGESZ, &addr);
+		for (pgn = 0; pgn < pages; pgn++) {
+			__write(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ, (BYTE)pgn);
+			__write(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ + 1,
+				ksm_tag(i, pgn, spct));
+		}
+	}
+	ns = now_ns() - start;
+
+	fprintf(stderr, "%-7s %7s %7s %7s %8s %8s %7s %10s\n", "stage", "procs",
+		"alike%", "write%", "frames", "merged", "cow", "us");
+	fprintf(stderr, "%-7s %7d %7d %7d %8d %8d %7d %10.1f\n", "load", nproc,
+		spct, wpct, frames - MEMPHY_count_freefp(mram), 0, 0, ns / 1000.0);
+
+	/* The first pass only takes the checksums */
+	for (pass = 1; pass <= 2; pass++) {
+		start = now_ns();
+		merged += ksm_scan(mram, frames);
+		ns = now_ns() - start;
+		fprintf(stderr, "scan %-2d %7d %7d %7d %8d %8d %7d %10.1f\n", pass,
+			nproc, spct, wpct, frames - MEMPHY_count_freefp(mram),
+			merged, 0, ns / 1000.0);
+	}
+
+	start = now_ns();
+	for (i = 0; i < nproc; i++)
+		for (pgn = 0; pgn < pages; pgn++)
+			if (fork_written(pgn, wpct))
+				__write(procs[i], 0, 0, (addr_t)pgn * PAGING_PAGESZ + 2,
+					(BYTE)(i + 1));
+	ns = now_ns() - start;
+
+	/* Merged or not, every worker sees its own bytes */
+	for (i = 0; i < nproc; i++) {
+		for (pgn = 0; pgn < pages; pgn++) {
+			addr = (addr_t)pgn * PAGING_PAGESZ;
+			tag = ksm_tag(i, pgn, spct);
+			want = fork_written(pgn, wpct) ? (BYTE)(i + 1) : 0;
+			if (__read(procs[i], 0, 0, addr, &data) != 0 || data != (BYTE)pgn ||
+			    __read(procs[i], 0, 0, addr + 1, &data) != 0 || data != tag ||
+			    __read(procs[i], 0, 0, addr + 2, &data) != 0 || data != want)
+				bad++;
+		}
+	}
+
+	cow = 0;
+	for (i = 0; i < nproc; i++)
+		cow += procs[i]->krnl->mm->cowflt;
+	fprintf(stderr, "%-7s %7d %7d %7d %8d %8d %7lu %10.1f\n", "write", nproc,
+		spct, wpct, frames - MEMPHY_count_freefp(mram), merged, cow,
+		ns / 1000.0);
+
+	for (i = 0; i < nproc; i++)
+		libexit(procs[i]);
+	if (MEMPHY_count_freefp(mram) != frames) {
+		fprintf(stderr, "%d frames left after exit\n",
+			frames - MEMPHY_count_freefp(mram));
+		bad++;
+	}
+	if (bad != 0) {
+		fprintf(stderr, "%d pages read back wrong\n", bad);
+		return 1;
+	}
+	return 0;
+}
+#endif
+
+/* The free frame list used before the bitmap, a node per free frame */
+struct fp_list {
+	pthread_mutex_t lock;
+	struct framephy_struct *head;
+	int free_cnt;
+};
+
+static void fp_list_format(struct fp_list *l, int frames)
+{
+	struct framephy_struct *fp;
+	int i;
+
+	pthread_mutex_init(&l->lock, NULL);
+	l->head = NULL;
+	for (i = frames - 1; i >= 0; i--) {
+		fp = malloc(sizeof(struct framephy_struct));
+		fp->fpn = i;
+		fp->fp_next = l->head;
+		l->head = fp;
+	}
+	l->free_cnt = frames;
+}
+
+static int fp_list_get(struct fp_list *l, addr_t *fpn)
+{
+	struct framephy_struct *fp;
+
+	pthread_mutex_lock(&l->lock);
+	fp = l->head;
+	if (fp == NULL) {
+		pthread_mutex_unlock(&l->lock);
+		return -1;
+	}
+	*fpn = fp->fpn;
+	l->head = fp->fp_next;
+	l->free_cnt--;
+	pthread_mutex_unlock(&l->lock);
+	free(fp);
+	return 0;
+}
+
+static void fp_list_put(struct fp_list *l, addr_t fpn)
+{
+	struct framephy_struct *fp = malloc(sizeof(struct framephy_struct));
+
+	fp->fpn = fpn;
+	pthread_mutex_lock(&l->lock);
+	fp->fp_next = l->head;
+	l->head = fp;
+	l->free_cnt++;
+	pthread_mutex_unlock(&l->lock);
+}
+
+static int frames_get(struct fp_list *l, struct memphy_struct *mp, addr_t *fpn)
+{
+	return l ? fp_list_get(l, fpn) : MEMPHY_get_freefp(mp, fpn);
+}
+
+static void frames_put(struct fp_list *l, struct memphy_struct *mp, addr_t fpn)
+{
+	if (l)
+		fp_list_put(l, fpn);
+	else
+		MEMPHY_put_freefp(mp, fpn);
+}
+
+/*
+ * frames - frame allocation cost of the free list against the bitmap:
+ * filling RAM, a fault load swapping random frames out and in while it
+ * is full, and giving everything back in random order. Huge page runs
+ * are taken from the bitmap as well.
+ */
+static int bench_frames(int argc, char *argv[])
+{
+	int frames = 65536, rounds = 8, run = 512;
+	struct memphy_struct ram;
+	struct fp_list list;
+	unsigned long start, ns[3];
+	addr_t *held, fpn;
+	char *seen;
+	size_t meta;
+	int opt, method, i, j, t, nops, nruns, bad = 0;
+
+	while ((opt = getopt(argc, argv, "f:r:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frames = atoi(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: bench frames [-f frames] [-r rounds]\n");
+			return 1;
+		}
+	}
+	if (frames <= 0 || rounds <= 0)
+		return 1;
+
+	held = malloc(frames * sizeof(addr_t));
+	seen = malloc(frames);
+	nops = frames * rounds;
+
+	fprintf(stderr, "%-7s %10s %10s %10s %10s %12s\n", "method", "frames",
+		"fill ns", "fault ns", "drain ns", "meta bytes");
+	for (method = 0; method < 2; method++) {
+		srand(1);
+		init_memphy(&ram, (addr_t)frames * PAGING_PAGESZ, 1);
+		if (method == 0) {
+			fp_list_format(&list, frames);
+			meta = (size_t)frames * sizeof(struct framephy_struct);
+		} else {
+			meta = (ram.fp_words + (ram.fp_words + 63) / 64) *
+			       sizeof(unsigned long);
+		}
+
+		start = now_ns();
+		for (i = 0; i < frames; i++)
+			if (frames_get(method ? NULL : &list, &ram, &held[i]) != 0)
+				bad++;
+		ns[0] = now_ns() - start;
+
+		memset(seen, 0, frames);
+		for (i = 0; i < frames; i++) {
+			if (held[i] >= (addr_t)frames || seen[held[i]]++)
+				bad++;
+		}
+
+		/* Out of frames, each fault gives one back and takes one */
+		start = now_ns();
+		for (i = 0; i < nops; i++) {
+			j = rand() % frames;
+			frames_put(method ? NULL : &list, &ram, held[j]);
+			if (frames_get(method ? NULL : &list, &ram, &held[j]) != 0)
+				bad++;
+		}
+		ns[1] = now_ns() - start;
+
+		for (i = frames - 1; i > 0; i--) {
+			j = rand() % (i + 1);
+			fpn = held[i];
+			held[i] = held[j];
+			held[j] = fpn;
+		}
+		start = now_ns();
+		for (i = 0; i < frames; i++)
+			frames_put(method ? NULL : &list, &ram, held[i]);
+		ns[2] = now_ns() - start;
+
+		t = method ? MEMPHY_count_freefp(&ram) : list.free_cnt;
+		if (t != frames)
+			bad++;
+
+		fprintf(stderr, "%-7s %10d %10.1f %10.1f %10.1f %12zu\n",
+			method ? "bitmap" : "list", frames, (double)ns[0] / frames,
+			(double)ns[1] / nops, (double)ns[2] / frames, meta);
+
+		if (method == 0) {
+			while (fp_list_get(&list, &fpn) == 0)
+				;
+		} else {
+			start = now_ns();
+			for (nruns = 0; MEMPHY_get_freefp_range(&ram, run, &fpn) == 0; nruns++)
+				if (fpn % run != 0)
+					bad++;
+			ns[0] = now_ns() - start;
+			if (nruns != frames / run)
+				bad++;
+			fprintf(stderr, "bitmap: %d runs of %d frames, %.1f ns each\n",
+				nruns, run, nruns ? (double)ns[0] / nruns : 0.0);
+		}
+		free_memphy(&ram);
+	}
+
+	free(held);
+	free(seen);
+	if (bad != 0) {
+		fprintf(stderr, "%d frames handed out wrong\n", bad);
+		return 1;
+	}
+	return 0;
+}
+
+static struct {
+	const char *name;
+	int (*run)(int argc, char *argv[]);
+	const char *help;
+} benches[] = {
+	{ "log", bench_log, "printf against the asynchronous log" },
+	{ "walk", bench_walk, "page table walks with and without the walk cache" },
+#ifdef MM64_HUGEPAGE
+	{ "huge", bench_huge, "4KB pages against 2MB PMD mappings" },
+#endif
+	{ "map", bench_map, "per-page mapping against pte_map_range()" },
+#ifdef MM64_FOLD
+	{ "pgtbl", bench_pgtbl, "page table footprint, folded root against full PGD" },
+#endif
+#ifdef MM_SWAP_RA
+	{ "swap", bench_swap, "demand paging of a heap larger than RAM" },
+#endif
+#ifdef MM_ZSWAP
+	{ "zswap", bench_zswap, "swap traffic with and without the compressed pool" },
+#endif
+	{ "swapdev", bench_swapdev, "swap I/O striped over devices and priorities" },
+	{ "pgcopy", bench_pgcopy, "page copies per second, bytewise against page operations" },
+	{ "memphy", bench_memphy, "host memory of a swap device on the heap and on a file" },
+	{ "reclaim", bench_reclaim, "faults and swap traffic of each replacement policy" },
+	{ "fork", bench_fork, "copy-on-write fork against loading each worker" },
+#ifdef MM_KSWAPD
+	{ "kswapd", bench_kswapd, "direct reclaim against the background kswapd thread" },
+#endif
+	{ "zero", bench_zero, "pages read before written on the shared zero frame" },
+#ifdef MM_KSM
+	{ "ksm", bench_ksm, "frames saved by merging identical pages of processes" },
+#endif
+	{ "frames", bench_frames, "frame allocation on the free list against the bitmap" },
+};
+
+#define NBENCH (int)(sizeof(benches) / sizeof(benches[0]))
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	if (argc >= 2) {
+		for (i = 0; i < NBENCH; i++) {
+			if (strcmp(argv[1], benches[i].name) == 0)
+				return benches[i].run(argc - 1, argv + 1);
+		}
+	}
+
+	fprintf(stderr, "Usage: bench <name> [options]\n");
+	for (i = 0; i < NBENCH; i++)
+		fprintf(stderr, "  %-10s %s\n", benches[i].name, benches[i].help);
+	return 1;
+}
@@ -4,6 +4,8 @@
 #include "syscall.h"
 #include "libmem.h"
 
+__thread int cpu_id = -1;
+
 int calc(struct pcb_t *proc)
 {
 	return ((unsigned long)proc & 0UL);
@@ -111,6 +113,25 @@ int run(struct pcb_t *proc)
     case SYSCALL:
         stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
         break;
+    case LOOP:
+        {
+            /* The counter lives in the code segment so it is reset
+             * on fall-through, nested loops then restart cleanly */
+            struct inst_t *loop = &proc->code->text[proc->pc - 1];
+            if (++loop->arg_2 < ins.arg_0) {
+                proc->pc = ins.arg_1;
+            } else {
+                loop->arg_2 = 0;
+            }
+        }
+        stat = 0;
+        break;
+    case JNZ:
+        if (proc->regs[ins.arg_0] != 0) {
+            proc->pc = ins.arg_1;
+        }
+        stat = 0;
+        break;
     default:
         stat = 1;
     }
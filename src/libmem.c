@@ -13,9 +13,17 @@
 #include "mm64.h"
 #include "syscall.h"
 #include "libmem.h"
+#include "log.h"
+#include "trace.h"
+#include "tlb.h"
+#include "cpu.h"
+#include "reclaim.h"
+#include "zswap.h"
+#include "swapdev.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <time.h>
 
 static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
 
@@ -70,7 +78,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, addr_t size, addr_t *allo
         addr_t needed_size = alloc_end - cur_vma->sbrk;
         
         if (inc_vma_limit(caller, vmaid, needed_size) != 0) {
-            printf("[ERROR] __alloc: Failed to expand VMA\n");
+            log_printf("[ERROR] __alloc: Failed to expand VMA\n");
             return -1;
         }
         // Sau khi expand, sbrk đã được cập nhật
@@ -106,14 +114,14 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
     struct vm_rg_struct *rgnode = &caller->krnl->mm->symrgtbl[rgid];
 
     if (rgnode->rg_start == 0 && rgnode->rg_end == 0) {
-        printf("[WARNING] __free: Process %d trying to free unallocated region %d\n", 
+        log_printf("[WARNING] __free: Process %d trying to free unallocated region %d\n", 
                caller->pid, rgid);
         pthread_mutex_unlock(&mmvm_lock);
         return -1;  // Không free region chưa được allocate
     }
 
     if (rgnode->rg_start >= rgnode->rg_end) {
-        printf("[WARNING] __free: Process %d region %d has invalid range [%lu-%lu]\n",
+        log_printf("[WARNING] __free: Process %d region %d has invalid range [%lu-%lu]\n",
                caller->pid, rgid, rgnode->rg_start, rgnode->rg_end);
         pthread_mutex_unlock(&mmvm_lock);
         return -1;
@@ -135,10 +143,11 @@ int liballoc(struct pcb_t *proc, addr_t size, uint32_t reg_index)
   
   if (val == 0) {
     proc->regs[reg_index] = addr;
+    TRACE(TRACE_ALLOC, proc->pid, size, addr);
   }
   
 #ifdef IODUMP
-  printf("liballoc:178\n");
+  log_printf("liballoc:178\n");
   print_pgtbl(proc, 0, 0);  
 #endif
 
@@ -150,62 +159,1116 @@ int liballoc(struct pcb_t *proc, addr_t size, uint32_t reg_index)
 int libfree(struct pcb_t *proc, uint32_t reg_index)
 {
   if (proc->regs[reg_index] == 0) {
-      printf("[WARNING] libfree: Process %d reg_index %d contains address 0, skipping free\n",
+      log_printf("[WARNING] libfree: Process %d reg_index %d contains address 0, skipping free\n",
              proc->pid, reg_index);
       return -1;
   }
   
   int val = __free(proc, 0, reg_index);
+
+  if (val == 0)
+    TRACE(TRACE_FREE, proc->pid, reg_index, 0);
   
 #ifdef IODUMP
-  printf("libfree:218\n");
+  log_printf("libfree:218\n");
   print_pgtbl(proc, 0, 0);
 #endif
   
   return val;
 }
 
-/*pg_getpage - get the page in ram */
-int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
+/* Fault counters of the whole run, under mmvm_lock */
+static unsigned long nr_minflt, nr_majflt, nr_swapout;
+static unsigned long nr_direct, nr_kswapd, nr_kswapd_wake;
+#if defined(MM64) && defined(MM_SWAP_RA)
+static unsigned long nr_ra_pages, nr_ra_hits, nr_ra_wasted;
+#endif
+#ifdef MM64
+static unsigned long nr_forks, nr_cow_shared, nr_cow_copied, nr_cow_reused;
+static unsigned long nr_zero_mapped, nr_zero_filled;
+#endif
+
+/* Largest swap readahead window, 1 turns readahead off */
+int swap_ra_max = PAGING_SWAP_RA_MAX;
+
+#ifdef MM_KSWAPD
+/*
+ * A running process translates and touches its frames without mmvm_lock,
+ * marking each access in mm->inflight. kswapd holds mmvm_lock, raises
+ * kswapd_stopping and waits for the processes on the CPUs to leave their
+ * accesses before it looks at their pages. An access started meanwhile
+ * backs off and waits on mmvm_lock, which kswapd holds until it is done.
+ */
+static int kswapd_stopping;
+static struct mm_struct **oncpu_mm;  /* per CPU, under mmvm_lock */
+static int nr_oncpu_mm;
+
+/* oncpu_set - [mm] now runs on [cpu], NULL when the CPU is left */
+static void oncpu_set(int cpu, struct mm_struct *mm)
 {
-  if (pgn < 0 || pgn >= PAGING_MAX_PGN) {
+  int i;
+
+  if (cpu < 0)
+    return;
+  if (cpu >= nr_oncpu_mm) {
+    oncpu_mm = realloc(oncpu_mm, (cpu + 1) * sizeof(struct mm_struct *));
+    for (i = nr_oncpu_mm; i <= cpu; i++)
+      oncpu_mm[i] = NULL;
+    nr_oncpu_mm = cpu + 1;
+  }
+  oncpu_mm[cpu] = mm;
+}
+
+static void mm_enter(struct mm_struct *mm)
+{
+  for (;;) {
+    __atomic_store_n(&mm->inflight, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&kswapd_stopping, __ATOMIC_SEQ_CST))
+      return;
+    __atomic_store_n(&mm->inflight, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&mmvm_lock);
+    pthread_mutex_unlock(&mmvm_lock);
+  }
+}
+
+static void mm_leave(struct mm_struct *mm)
+{
+  __atomic_store_n(&mm->inflight, 0, __ATOMIC_RELEASE);
+}
+
+/* A fault inside an access leaves it while waiting for mmvm_lock */
+static void mm_lock(struct mm_struct *mm)
+{
+  mm_leave(mm);
+  pthread_mutex_lock(&mmvm_lock);
+}
+
+/* and is back in it before letting go, kswapd is not stopping meanwhile */
+static void mm_unlock(struct mm_struct *mm)
+{
+  __atomic_store_n(&mm->inflight, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&mmvm_lock);
+}
+
+/* stop_cpus - keep the running processes off their pages, under mmvm_lock */
+static void stop_cpus(void)
+{
+  struct timespec yield = { 0, 0 };
+  int i;
+
+  __atomic_store_n(&kswapd_stopping, 1, __ATOMIC_SEQ_CST);
+  for (i = 0; i < nr_oncpu_mm; i++) {
+    if (oncpu_mm[i] == NULL)
+      continue;
+    while (__atomic_load_n(&oncpu_mm[i]->inflight, __ATOMIC_SEQ_CST))
+      nanosleep(&yield, NULL);  /* it may be off the host CPU */
+  }
+}
+
+static void resume_cpus(void)
+{
+  __atomic_store_n(&kswapd_stopping, 0, __ATOMIC_RELEASE);
+}
+#else
+#define mm_enter(mm) do { } while (0)
+#define mm_leave(mm) do { } while (0)
+#define mm_lock(mm) pthread_mutex_lock(&mmvm_lock)
+#define mm_unlock(mm) pthread_mutex_unlock(&mmvm_lock)
+#endif
+
+/*libexit - release the address space of an exiting process */
+int libexit(struct pcb_t *proc)
+{
+  int val;
+
+  pthread_mutex_lock(&mmvm_lock);
+#if defined(MM64) && defined(MM_SWAP_RA)
+  /* Hits are counted by the process itself without the lock */
+  nr_ra_hits += proc->krnl->mm->ra_hits;
+#endif
+  reclaim_unpark(proc->krnl->mm->oncpu);
+#ifdef MM_KSWAPD
+  oncpu_set(proc->krnl->mm->oncpu, NULL);
+#endif
+  val = free_mm(proc->krnl->mm, proc);
+  proc->krnl->mm = NULL;
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return val;
+}
+
+/* swap_read_page - Copy the swapped out page [pte] refers to into frame [fpn] */
+static void swap_read_page(struct krnl_t *krnl, pte_t pte, addr_t fpn)
+{
+#ifdef MM_ZSWAP
+  if (PAGING_PTE_SWPTYP(pte) == PAGING_SWPTYP_ZSWAP) {
+    zswap_load(PAGING_PTE_SWP(pte), krnl->mram->storage + fpn * PAGING_PAGESZ);
+    return;
+  }
+#endif
+  swapdev_read(PAGING_PTE_SWPTYP(pte), PAGING_PTE_SWP(pte), krnl->mram, fpn);
+}
+
+/* swap_put_slot - Release the swap space of [pte] once its page is back */
+static void swap_put_slot(struct krnl_t *krnl, pte_t pte)
+{
+#ifdef MM_ZSWAP
+  if (PAGING_PTE_SWPTYP(pte) == PAGING_SWPTYP_ZSWAP) {
+    zswap_invalidate(PAGING_PTE_SWP(pte));
+    return;
+  }
+#endif
+  swapdev_put_slot(PAGING_PTE_SWPTYP(pte), PAGING_PTE_SWP(pte));
+}
+
+/* swap_dup_slot - One more swap entry refers to slot [swpoff] of [swptyp] */
+static void swap_dup_slot(int swptyp, addr_t swpoff)
+{
+#ifdef MM_ZSWAP
+  if (swptyp == PAGING_SWPTYP_ZSWAP) {
+    zswap_dup(swpoff);
+    return;
+  }
+#endif
+  swapdev_dup_slot(swptyp, swpoff);
+}
+
+/*
+ * swap_out_page - Free a RAM frame by moving a page to the compressed
+ * pool or, when the pool turns it down, to a swap device
+ * @caller : process needing the frame
+ * @fpn    : the frame now free for reuse
+ *
+ * The victim is chosen over all of RAM by the frame table and may belong
+ * to any process that is not running on another CPU. kswapd passes a
+ * NULL [caller] with the CPUs stopped, any page may go then. A frame
+ * shared since a fork is written out once for all its mappers.
+ */
+static int swap_out_page(struct pcb_t *caller, addr_t *fpn)
+{
+  struct pcb_t *owner;
+  addr_t vicpgn, vicfpn, swpfpn;
+  int swptyp;
+
+  if (reclaim_victim(caller, &owner, &vicpgn, &vicfpn) != 0)
     return -1;
+
+#if defined(MM64) && defined(MM_SWAP_RA)
+  if (pte_get_entry(owner, vicpgn) & PAGING_PTE_READAHEAD_MASK) {
+    owner->krnl->mm->ra_wasted++;
+    nr_ra_wasted++;
   }
+#endif
 
-  // Kiểm tra page đã được map chưa
-  uint32_t pte = pte_get_entry(caller, pgn);
-  
-  if (PAGING_PAGE_PRESENT(pte)) {
-    *fpn = PAGING_FPN(pte);
+#ifdef MM_ZSWAP
+  if (zswap_store(owner->krnl->mram->storage + vicfpn * PAGING_PAGESZ,
+                  &swpfpn) == 0) {
+    swptyp = PAGING_SWPTYP_ZSWAP;
+  } else
+#endif
+  if (swapdev_get_slot(&swptyp, &swpfpn) == 0) {
+    swapdev_write(swptyp, swpfpn, owner->krnl->mram, vicfpn);
+  } else {
+    reclaim_track(owner, vicfpn, vicpgn);
+    return -1; /* Swap is full */
+  }
+
+  TRACE(TRACE_SWAPOUT, owner->pid, vicfpn, swpfpn);
+  pte_set_swap(owner, vicpgn, swptyp, swpfpn);
+  owner->krnl->mm->swapout++;
+
+  /* A frame shared since a fork leaves every mapper, the slot is shared */
+  while (reclaim_pop_map(vicfpn, &owner, &vicpgn) == 0) {
+    swap_dup_slot(swptyp, swpfpn);
+    pte_set_swap(owner, vicpgn, swptyp, swpfpn);
+    owner->krnl->mm->swapout++;
+  }
+
+  nr_swapout++;
+  if (caller != NULL)
+    nr_direct++;
+  else
+    nr_kswapd++;
+
+  *fpn = vicfpn;
+  return 0;
+}
+
+#ifdef MM64
+static int pg_fault(struct pcb_t *caller, addr_t pgn, pte_t pte, addr_t *fpn,
+                    int write);
+
+/*
+ * zero_fault - Map page [pgn], read before it was ever written, onto the
+ * shared zero frame write protected. cow_fault() gives it a frame of its
+ * own on the first write.
+ *
+ * Called with mmvm_lock held.
+ */
+static int zero_fault(struct pcb_t *caller, addr_t pgn, addr_t *fpn)
+{
+  struct krnl_t *krnl = caller->krnl;
+  addr_t zerofpn, tblfpn;
+
+  while (MEMPHY_get_zerofp(krnl->mram, &zerofpn) != 0) {
+    if (swap_out_page(caller, &tblfpn) != 0)
+      return -1;
+    MEMPHY_put_freefp(krnl->mram, tblfpn);
+  }
+
+  while (pte_set_fpn(caller, pgn, zerofpn) != 0) {
+    if (swap_out_page(caller, &tblfpn) != 0) {
+      MEMPHY_put_zerofp(krnl->mram);
+      return -1;
+    }
+    MEMPHY_put_freefp(krnl->mram, tblfpn);
+  }
+  pte_set_flags(caller, pgn, PAGING_PTE_COW_MASK);
+
+  TRACE(TRACE_FAULT, caller->pid, pgn, zerofpn);
+  krnl->mm->minflt++;
+  nr_minflt++;
+  nr_zero_mapped++;
+  *fpn = zerofpn;
+  return 0;
+}
+
+/*
+ * cow_fault - Give [caller] its own copy of page [pgn], shared since a
+ * fork or a merge, on its first write. The last process mapping the
+ * frame keeps it and only loses the write protection. A page on the
+ * zero frame gets a cleared frame.
+ *
+ * Called with mmvm_lock held.
+ */
+static int cow_fault(struct pcb_t *caller, addr_t pgn, addr_t *fpn)
+{
+  struct krnl_t *krnl = caller->krnl;
+  pte_t pte = pte_get_entry(caller, pgn);
+  addr_t oldfpn = PAGING_PTE_FPN(pte), newfpn;
+  int zero;
+
+  if (!(pte & PAGING_PTE_COW_MASK)) {
+    *fpn = oldfpn;
     return 0;
   }
 
-  // Page is not present, allocate and map it
-  addr_t new_fpn;
-  if (MEMPHY_get_freefp(caller->krnl->mram, &new_fpn) == 0) {
-    // Map the page
-    if (pte_set_fpn(caller, pgn, new_fpn) == 0) {
-      // Thêm vào FIFO list cho page replacement
-      if (caller->krnl->mm->fifo_pgn == NULL) {
-        caller->krnl->mm->fifo_pgn = malloc(sizeof(struct pgn_t));
-        caller->krnl->mm->fifo_pgn->pgn = pgn;
-        caller->krnl->mm->fifo_pgn->pg_next = NULL;
-      } else {
-        struct pgn_t *new_node = malloc(sizeof(struct pgn_t));
-        new_node->pgn = pgn;
-        new_node->pg_next = caller->krnl->mm->fifo_pgn;
-        caller->krnl->mm->fifo_pgn = new_node;
+  zero = MEMPHY_is_zerofp(krnl->mram, oldfpn);
+  if (!zero && reclaim_mapcount(oldfpn) <= 1) {
+    pte_clear_flags(caller, pgn, PAGING_PTE_COW_MASK);
+    nr_cow_reused++;
+    *fpn = oldfpn;
+    return 0;
+  }
+
+  if (MEMPHY_get_freefp(krnl->mram, &newfpn) != 0) {
+    if (swap_out_page(caller, &newfpn) != 0)
+      return -1;
+    /* The shared frame may be the victim, the page then comes back from swap */
+    pte = pte_get_entry(caller, pgn);
+    if (PAGING_PTE_SWAPPED(pte)) {
+      MEMPHY_put_freefp(krnl->mram, newfpn);
+      return pg_fault(caller, pgn, pte, fpn, 1);
+    }
+  }
+  if (zero)
+    MEMPHY_zero_page(krnl->mram, newfpn);
+  else
+    MEMPHY_copy_page(krnl->mram, oldfpn, krnl->mram, newfpn);
+
+  /* The PT page is there, the map cannot fail */
+  pte_set_fpn(caller, pgn, newfpn);
+  reclaim_track(caller, newfpn, pgn);
+
+  TRACE(TRACE_FAULT, caller->pid, pgn, newfpn);
+  if (zero) {
+    MEMPHY_put_zerofp(krnl->mram);
+    nr_zero_filled++;
+  } else {
+    reclaim_unmap(oldfpn, caller);
+    krnl->mm->cowflt++;
+    nr_cow_copied++;
+  }
+  *fpn = newfpn;
+  return 0;
+}
+
+/* dup_mmap - Give [mm] copies of the areas, free lists and regions of [oldmm] */
+static void dup_mmap(struct mm_struct *mm, struct mm_struct *oldmm)
+{
+  struct vm_area_struct *vma, *nvma, **pvma;
+  struct vm_rg_struct *rg, *nrg, **prg;
+  int i;
+
+  /* Drop the empty area init_mm() set up */
+  for (vma = mm->mmap; vma != NULL; vma = nvma) {
+    nvma = vma->vm_next;
+    for (rg = vma->vm_freerg_list; rg != NULL; rg = nrg) {
+      nrg = rg->rg_next;
+      free(rg);
+    }
+    free(vma);
+  }
+
+  pvma = &mm->mmap;
+  for (vma = oldmm->mmap; vma != NULL; vma = vma->vm_next) {
+    nvma = malloc(sizeof(struct vm_area_struct));
+    *nvma = *vma;
+    nvma->vm_mm = mm;
+    nvma->vm_next = NULL;
+    prg = &nvma->vm_freerg_list;
+    for (rg = vma->vm_freerg_list; rg != NULL; rg = rg->rg_next) {
+      *prg = init_vm_rg(rg->rg_start, rg->rg_end);
+      prg = &(*prg)->rg_next;
+    }
+    *pvma = nvma;
+    pvma = &nvma->vm_next;
+  }
+
+  for (i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
+    mm->symrgtbl[i] = oldmm->symrgtbl[i];
+    mm->symrgtbl[i].rg_next = NULL;
+  }
+}
+
+/* fork_set_pte - Enter [pte] for [pgn] in the table of [child], making room for table pages */
+static int fork_set_pte(struct pcb_t *parent, struct pcb_t *child,
+                        addr_t pgn, pte_t pte)
+{
+  addr_t tblfpn;
+
+  while (pte_set_entry(child, pgn, pte) != 0) {
+    if (swap_out_page(parent, &tblfpn) != 0)
+      return -1;
+    MEMPHY_put_freefp(parent->krnl->mram, tblfpn);
+  }
+  return 0;
+}
+
+/*
+ * fork_pte - Map page [pgn] of [parent] into [child]
+ *
+ * A resident page is shared write protected in both, a swapped one
+ * shares the swap space. Frames of huge mappings are not tracked for
+ * reclaim, so they cannot be shared and are copied right away.
+ */
+static int fork_pte(struct pcb_t *parent, struct pcb_t *child, addr_t pgn)
+{
+  struct memphy_struct *mram = parent->krnl->mram;
+  pte_t pte = pte_get_entry(parent, pgn);
+  addr_t fpn, newfpn;
+
+  if (!PAGING_PTE_PRESENT(pte))
+    return 0;
+
+  /* Tables first, making room for them may swap the page itself out */
+  if (fork_set_pte(parent, child, pgn, 0) != 0)
+    return -1;
+  pte = pte_get_entry(parent, pgn);
+
+  if (PAGING_PTE_SWAPPED(pte)) {
+    swap_dup_slot(PAGING_PTE_SWPTYP(pte), PAGING_PTE_SWP(pte));
+    pte_set_entry(child, pgn, pte);
+    return 0;
+  }
+
+  fpn = PAGING_PTE_FPN(pte);
+  if ((fpn + 1) * PAGING_PAGESZ > (addr_t)mram->maxsz)
+    return 0;  /* Not a RAM frame, memmap test mappings */
+
+  if (MEMPHY_is_zerofp(mram, fpn)) {
+    MEMPHY_get_zerofp(mram, &fpn);
+    pte_set_entry(child, pgn, pte);
+    return 0;
+  }
+
+  if (reclaim_mapcount(fpn) > 0) {
+    pte = (pte | PAGING_PTE_COW_MASK) & ~PAGING_PTE_DIRTY_MASK;
+    pte_set_entry(parent, pgn, pte);
+    pte_set_entry(child, pgn, pte);
+    reclaim_share(fpn, child, pgn);
+    nr_cow_shared++;
+    return 0;
+  }
+
+  if (MEMPHY_get_freefp(mram, &newfpn) != 0 &&
+      swap_out_page(parent, &newfpn) != 0)
+    return -1;
+  MEMPHY_copy_page(mram, fpn, mram, newfpn);
+  pte &= ~PAGING_PTE_FPN_MASK;
+  SETVAL(pte, newfpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  pte_set_entry(child, pgn, pte);
+  reclaim_track(child, newfpn, pgn);
+  return 0;
+}
+#endif
+
+/*
+ * libfork - Give [child] a copy-on-write copy of the address space of
+ * [parent]
+ *
+ * [child] must have its krnl, the mm is created here. Frames are shared
+ * until one side writes, see cow_fault(). Returns -1 with nothing left
+ * behind in [child] when RAM or swap runs out.
+ */
+int libfork(struct pcb_t *parent, struct pcb_t *child)
+{
+#ifdef MM64
+  struct mm_struct *oldmm = parent->krnl->mm, *mm;
+  struct vm_area_struct *vma;
+  addr_t pgn, end;
+  int ret = 0;
+
+  mm = malloc(sizeof(struct mm_struct));
+  if (mm == NULL || init_mm(mm, child) != 0) {
+    free(mm);
+    return -1;
+  }
+  child->krnl->mm = mm;
+
+  pthread_mutex_lock(&mmvm_lock);
+  dup_mmap(mm, oldmm);
+  for (vma = oldmm->mmap; vma != NULL && ret == 0; vma = vma->vm_next) {
+    end = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ);
+    for (pgn = vma->vm_start / PAGING_PAGESZ; pgn < end && ret == 0; pgn++)
+      ret = fork_pte(parent, child, pgn);
+  }
+
+  if (ret != 0) {
+    free_mm(mm, child);
+    child->krnl->mm = NULL;
+  } else {
+    nr_forks++;
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+  return ret;
+#else
+  return -1;
+#endif
+}
+
+#if defined(MM64) && defined(MM_SWAP_RA)
+/*
+ * ra_window - Pages to swap in around a major fault at [pgn], the
+ * faulting one included
+ *
+ * The window grows with the readahead pages used since the last major
+ * fault and shrinks by at most half per fault. Without hits a fault next
+ * to the previous one still reads one page ahead, so a sequential pass
+ * gets started.
+ */
+static int ra_window(struct mm_struct *mm, addr_t pgn)
+{
+  int win = mm->ra_recent + 2, pow;
+
+  if (win == 2) {
+    if (pgn != mm->ra_prev + 1 && pgn + 1 != mm->ra_prev)
+      win = 1;
+  } else {
+    for (pow = 2; pow < win; pow <<= 1)
+      ;
+    win = pow;
+  }
+  if (win > swap_ra_max)
+    win = swap_ra_max;
+  if (win < mm->ra_win / 2)
+    win = mm->ra_win / 2;
+
+  mm->ra_recent = 0;
+  mm->ra_win = win;
+  return win;
+}
+
+/*
+ * swap_readahead - Swap in the virtual neighbours of [pgn] after its
+ * major fault, in the direction the faults are moving
+ *
+ * Neighbours are taken by page number rather than by swap slot: slots
+ * come off a LIFO free list, so pages swapped out together rarely keep
+ * adjacent slots after the first pass, while a swap slot costs the same
+ * to read wherever it is. The run stops at the first neighbour that is
+ * not in swap. RAM is made room for like on any fault. The pages come in with the
+ * readahead bit set and the accessed bit clear, so replacement sees them
+ * as unused. [pgn] must not be tracked yet, it cannot be the victim that
+ * way. Called with mmvm_lock held.
+ */
+static void swap_readahead(struct pcb_t *caller, addr_t pgn)
+{
+  struct krnl_t *krnl = caller->krnl;
+  struct mm_struct *mm = krnl->mm;
+  int dir = (pgn + 1 == mm->ra_prev) ? -1 : 1;
+  int win = ra_window(mm, pgn), k;
+  addr_t rapgn, raswp, rafpn;
+  pte_t pte;
+
+  mm->ra_prev = pgn;
+  for (k = 1; k < win; k++) {
+    rapgn = pgn + dir * k;
+    if (rapgn >= PAGING_MAX_PGN)  /* wraps below 0 too */
+      break;
+
+    pte = pte_get_entry(caller, rapgn);
+    if (!PAGING_PTE_PRESENT(pte) || !PAGING_PTE_SWAPPED(pte))
+      break;
+    raswp = PAGING_PTE_SWP(pte);
+
+    if (MEMPHY_get_freefp(krnl->mram, &rafpn) != 0 &&
+        swap_out_page(caller, &rafpn) != 0)
+      break;
+    swap_read_page(krnl, pte, rafpn);
+    if (pte_set_fpn(caller, rapgn, rafpn) != 0) {
+      MEMPHY_put_freefp(krnl->mram, rafpn);
+      break;
+    }
+    pte_set_flags(caller, rapgn, PAGING_PTE_READAHEAD_MASK);
+    swap_put_slot(krnl, pte);
+    reclaim_track(caller, rafpn, rapgn);
+
+    TRACE(TRACE_SWAPIN, caller->pid, rafpn, raswp);
+    mm->ra_pages++;
+    nr_ra_pages++;
+  }
+}
+#endif
+
+#ifdef MM_KSWAPD
+/*
+ * Background reclaim
+ *
+ * kswapd sleeps until a fault leaves fewer than wmark_low frames of RAM
+ * free, then evicts cold pages until wmark_high frames are free. The
+ * running processes are held off their pages during each eviction, so
+ * kswapd may take theirs too. mmvm_lock is dropped between evictions so
+ * the faults of the CPUs go on meanwhile.
+ */
+static pthread_t kswapd_thread;
+static pthread_cond_t kswapd_wait = PTHREAD_COND_INITIALIZER;
+static struct memphy_struct *kswapd_mram;
+static int wmark_low, wmark_high;
+static int kswapd_running, kswapd_pending;
+static int kswapd_stalled;  /* nothing evictable until a process is preempted */
+
+static void *kswapd(void *arg)
+{
+  addr_t fpn;
+  int ret;
+
+  cpu_id = TRACE_CPU_KSWAPD;
+  pthread_mutex_lock(&mmvm_lock);
+  for (;;) {
+    while (kswapd_running && !kswapd_pending)
+      pthread_cond_wait(&kswapd_wait, &mmvm_lock);
+    if (!kswapd_running)
+      break;
+    kswapd_pending = 0;
+    nr_kswapd_wake++;
+
+    while (kswapd_running && MEMPHY_count_freefp(kswapd_mram) < wmark_high) {
+      stop_cpus();
+      ret = swap_out_page(NULL, &fpn);
+      resume_cpus();
+      if (ret != 0) {
+        kswapd_stalled = 1;  /* Every page left is parked, or swap is full */
+        break;
       }
-      
-      *fpn = new_fpn;
+      MEMPHY_put_freefp(kswapd_mram, fpn);
+      pthread_mutex_unlock(&mmvm_lock);
+      pthread_mutex_lock(&mmvm_lock);
+    }
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+  return NULL;
+}
+
+/* kswapd_wakeup - start background reclaim when [mram] runs low, under mmvm_lock */
+static void kswapd_wakeup(struct memphy_struct *mram)
+{
+  if (mram == kswapd_mram && !kswapd_pending && !kswapd_stalled &&
+      MEMPHY_count_freefp(mram) < wmark_low) {
+    kswapd_pending = 1;
+    pthread_cond_signal(&kswapd_wait);
+  }
+}
+
+/*kswapd_start - keep free frames of [mram] between the watermarks */
+void kswapd_start(struct memphy_struct *mram)
+{
+  int nframes = mram->maxsz / PAGING_PAGESZ;
+
+  wmark_low = nframes * PAGING_WMARK_LOW / 100;
+  if (wmark_low < 1)
+    wmark_low = 1;
+  wmark_high = nframes * PAGING_WMARK_HIGH / 100;
+  if (wmark_high <= wmark_low)
+    wmark_high = wmark_low + 1;
+
+  kswapd_mram = mram;
+  kswapd_running = 1;
+  kswapd_pending = 0;
+  kswapd_stalled = 0;
+  pthread_create(&kswapd_thread, NULL, kswapd, NULL);
+}
+
+/*kswapd_stop - end background reclaim and wait for kswapd to leave */
+void kswapd_stop(void)
+{
+  pthread_mutex_lock(&mmvm_lock);
+  if (!kswapd_running) {
+    pthread_mutex_unlock(&mmvm_lock);
+    return;
+  }
+  kswapd_running = 0;
+  pthread_cond_signal(&kswapd_wait);
+  pthread_mutex_unlock(&mmvm_lock);
+
+  pthread_join(kswapd_thread, NULL);
+  kswapd_mram = NULL;
+}
+#endif
+
+#if defined(MM64) && defined(MM_KSM)
+/*
+ * Same page merging
+ *
+ * ksmd wakes every ksm_sleep_ms and looks at the next ksm_pages_to_scan
+ * frames of RAM. A frame whose checksum is the same as at its last look
+ * is looked up among the frames seen before, one candidate per checksum
+ * bucket. When the candidate holds the same bytes, the mappers of the
+ * frame move over to it write protected, as after a fork, and the frame
+ * is freed. A write breaks the sharing again in cow_fault(). As in
+ * reclaim, frames of a process on a CPU are left alone, and so are two
+ * pages of one process, the frame table keeps one mapping per process.
+ */
+#define KSM_MAX_MAPS 16
+
+int ksm_pages_to_scan = PAGING_KSM_PAGES;
+int ksm_sleep_ms = PAGING_KSM_SLEEP_MS;
+
+static pthread_t ksm_thread;
+static pthread_cond_t ksm_wait = PTHREAD_COND_INITIALIZER;
+static int ksm_running;
+static struct memphy_struct *ksm_mram;
+static uint32_t *ksm_sums;  /* checksum of each frame at its last look */
+static int *ksm_bucket;     /* frame + 1 per checksum bucket, 0 when empty */
+static int ksm_nframes, ksm_nbuckets, ksm_cursor;
+
+/* Same page merging counters, under mmvm_lock */
+static unsigned long nr_ksm_scans, nr_ksm_merged;
+
+static uint32_t ksm_checksum(const BYTE *page)
+{
+  const uint64_t *w = (const uint64_t *)page;
+  uint64_t h = 14695981039346656037ULL;
+  int i;
+
+  for (i = 0; i < PAGING_PAGESZ / 8; i++)
+    h = (h ^ w[i]) * 1099511628211ULL;
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+/* ksm_attach - size the tables for [mram], under mmvm_lock */
+static void ksm_attach(struct memphy_struct *mram)
+{
+  int nframes = mram->maxsz / PAGING_PAGESZ;
+
+  if (mram == ksm_mram && nframes == ksm_nframes)
+    return;
+
+  free(ksm_sums);
+  free(ksm_bucket);
+  for (ksm_nbuckets = 1; ksm_nbuckets < 2 * nframes; ksm_nbuckets <<= 1)
+    ;
+  ksm_sums = calloc(nframes, sizeof(uint32_t));
+  ksm_bucket = calloc(ksm_nbuckets, sizeof(int));
+  ksm_mram = mram;
+  ksm_nframes = nframes;
+  ksm_cursor = 0;
+}
+
+/* The mappings of [fpn] when it may be merged, 0 when it may not */
+static int ksm_maps(addr_t fpn, struct pcb_t **owner, addr_t *pgn)
+{
+  int i, n = reclaim_maps(fpn, owner, pgn, KSM_MAX_MAPS);
+
+  if (n > KSM_MAX_MAPS)
+    return 0;
+  for (i = 0; i < n; i++)
+    if (owner[i]->krnl->mm->oncpu >= 0)
       return 0;
-    } else {
-      MEMPHY_put_freefp(caller->krnl->mram, new_fpn);
+  return n;
+}
+
+/* Map page [pgn] of [owner] write protected onto frame [fpn] */
+static void ksm_set_pte(struct pcb_t *owner, addr_t pgn, addr_t fpn)
+{
+  pte_t pte = pte_get_entry(owner, pgn);
+
+  pte = (pte | PAGING_PTE_COW_MASK) & ~(PAGING_PTE_DIRTY_MASK | PAGING_PTE_FPN_MASK);
+  SETVAL(pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  pte_set_entry(owner, pgn, pte);
+}
+
+/* ksm_merge - move the mappers of [fpn] onto [into] and free [fpn] */
+static int ksm_merge(struct memphy_struct *mram, addr_t fpn, addr_t into)
+{
+  struct pcb_t *owner[KSM_MAX_MAPS], *kowner[KSM_MAX_MAPS];
+  addr_t pgn[KSM_MAX_MAPS], kpgn[KSM_MAX_MAPS];
+  int n, kn, i, j;
+
+  n = ksm_maps(fpn, owner, pgn);
+  kn = ksm_maps(into, kowner, kpgn);
+  if (n == 0 || kn == 0 || n + kn > KSM_MAX_MAPS)
+    return -1;
+  for (i = 0; i < n; i++)
+    for (j = 0; j < kn; j++)
+      if (owner[i] == kowner[j])
+        return -1;
+  if (memcmp(mram->storage + fpn * PAGING_PAGESZ,
+             mram->storage + into * PAGING_PAGESZ, PAGING_PAGESZ) != 0)
+    return -1;
+
+  for (j = 0; j < kn; j++)
+    ksm_set_pte(kowner[j], kpgn[j], into);
+  for (i = 0; i < n; i++) {
+    ksm_set_pte(owner[i], pgn[i], into);
+    reclaim_share(into, owner[i], pgn[i]);
+    reclaim_unmap(fpn, owner[i]);
+  }
+  MEMPHY_put_freefp(mram, fpn);
+  return 0;
+}
+
+/* ksm_scan_frame - look at frame [fpn] once, under mmvm_lock */
+static void ksm_scan_frame(struct memphy_struct *mram, addr_t fpn)
+{
+  struct pcb_t *owner[KSM_MAX_MAPS];
+  addr_t pgn[KSM_MAX_MAPS];
+  uint32_t sum;
+  int b, cand;
+
+  if (ksm_maps(fpn, owner, pgn) == 0)
+    return;
+
+  /* A page still being written is not worth merging */
+  sum = ksm_checksum(mram->storage + fpn * PAGING_PAGESZ);
+  if (sum != ksm_sums[fpn]) {
+    ksm_sums[fpn] = sum;
+    return;
+  }
+
+  b = sum & (ksm_nbuckets - 1);
+  cand = ksm_bucket[b] - 1;
+  if (cand >= 0 && (addr_t)cand != fpn && ksm_sums[cand] == sum &&
+      ksm_merge(mram, fpn, cand) == 0) {
+    nr_ksm_merged++;
+    return;
+  }
+  ksm_bucket[b] = fpn + 1;
+}
+
+/*ksm_scan - look at the next [nr] frames of [mram], returns the pages merged */
+int ksm_scan(struct memphy_struct *mram, int nr)
+{
+  unsigned long merged;
+
+  pthread_mutex_lock(&mmvm_lock);
+  ksm_attach(mram);
+  merged = nr_ksm_merged;
+  for (; nr > 0; nr--) {
+    ksm_scan_frame(mram, ksm_cursor);
+    if (++ksm_cursor == ksm_nframes) {
+      ksm_cursor = 0;
+      nr_ksm_scans++;
+    }
+    /* Let the faults of the CPUs in between frames */
+    pthread_mutex_unlock(&mmvm_lock);
+    pthread_mutex_lock(&mmvm_lock);
+  }
+  merged = nr_ksm_merged - merged;
+  pthread_mutex_unlock(&mmvm_lock);
+  return merged;
+}
+
+static void *ksmd(void *arg)
+{
+  struct timespec ts;
+
+  cpu_id = TRACE_CPU_KSMD;
+  pthread_mutex_lock(&mmvm_lock);
+  while (ksm_running) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += ksm_sleep_ms * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait(&ksm_wait, &mmvm_lock, &ts);
+    if (!ksm_running)
+      break;
+    pthread_mutex_unlock(&mmvm_lock);
+    ksm_scan(ksm_mram, ksm_pages_to_scan);
+    pthread_mutex_lock(&mmvm_lock);
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+  return NULL;
+}
+
+/*ksm_start - merge identical pages of [mram] in the background */
+void ksm_start(struct memphy_struct *mram)
+{
+  pthread_mutex_lock(&mmvm_lock);
+  ksm_attach(mram);
+  ksm_running = 1;
+  pthread_mutex_unlock(&mmvm_lock);
+  pthread_create(&ksm_thread, NULL, ksmd, NULL);
+}
+
+/*ksm_stop - end the merging and wait for ksmd to leave */
+void ksm_stop(void)
+{
+  pthread_mutex_lock(&mmvm_lock);
+  if (!ksm_running) {
+    pthread_mutex_unlock(&mmvm_lock);
+    return;
+  }
+  ksm_running = 0;
+  pthread_cond_signal(&ksm_wait);
+  pthread_mutex_unlock(&mmvm_lock);
+
+  pthread_join(ksm_thread, NULL);
+}
+#endif
+
+/*
+ * pg_fault - Bring a page that is not resident into RAM, from swap when
+ * it was swapped out (major fault) or onto a new cleared frame (minor
+ * fault). A page never written is read from the shared zero frame.
+ * @pte   : the entry of [pgn] seen by the caller
+ * @write : the access is a write
+ *
+ * Called with mmvm_lock held.
+ */
+static int pg_fault(struct pcb_t *caller, addr_t pgn, pte_t pte, addr_t *fpn,
+                    int write)
+{
+  struct krnl_t *krnl = caller->krnl;
+  int swapped = PAGING_PTE_PRESENT(pte) && PAGING_PTE_SWAPPED(pte);
+  addr_t newfpn, swpfpn = 0, tblfpn;
+
+#if defined(MM64) && defined(MM64_HUGEPAGE)
+  /* Large heaps take the whole 2MB region on the first fault */
+  if (!swapped && pmd_map_huge(caller, pgn, &newfpn) == 0) {
+    TRACE(TRACE_FAULT, caller->pid, pgn, newfpn);
+    krnl->mm->minflt++;
+    nr_minflt++;
+    *fpn = newfpn;
+    return 0;
+  }
+#endif
+#ifdef MM64
+  if (!swapped && !write)
+    return zero_fault(caller, pgn, fpn);
+#endif
+
+  if (MEMPHY_get_freefp(krnl->mram, &newfpn) != 0 &&
+      swap_out_page(caller, &newfpn) != 0)
+    return -1;
+
+  if (swapped) {
+    swpfpn = PAGING_PTE_SWP(pte);
+    swap_read_page(krnl, pte, newfpn);
+  } else {
+    MEMPHY_zero_page(krnl->mram, newfpn);
+  }
+
+  /* Page table frames come out of RAM too, make room until the map sticks */
+  while (pte_set_fpn(caller, pgn, newfpn) != 0) {
+    if (swap_out_page(caller, &tblfpn) != 0) {
+      MEMPHY_put_freefp(krnl->mram, newfpn);
       return -1;
     }
+    MEMPHY_put_freefp(krnl->mram, tblfpn);
+  }
+
+  if (swapped) {
+    swap_put_slot(krnl, pte);
+    TRACE(TRACE_SWAPIN, caller->pid, newfpn, swpfpn);
+    krnl->mm->majflt++;
+    nr_majflt++;
   } else {
+    TRACE(TRACE_FAULT, caller->pid, pgn, newfpn);
+    krnl->mm->minflt++;
+    nr_minflt++;
+  }
+
+#if defined(MM64) && defined(MM_SWAP_RA)
+  if (swapped)
+    swap_readahead(caller, pgn);
+#endif
+
+  /* Tracking for page replacement */
+  reclaim_track(caller, newfpn, pgn);
+
+#ifdef MM_KSWAPD
+  kswapd_wakeup(krnl->mram);
+#endif
+
+  *fpn = newfpn;
+  return 0;
+}
+
+/*
+ * libswitch - note that [proc] was switched onto [cpu], or off its CPU
+ * when [cpu] is -1
+ *
+ * Taken under mmvm_lock, so a process is never dispatched while one of
+ * its pages is being evicted by another CPU.
+ */
+void libswitch(struct pcb_t *proc, int cpu)
+{
+  struct mm_struct *mm = proc->krnl->mm;
+
+  pthread_mutex_lock(&mmvm_lock);
+  if (mm != NULL) {
+#ifdef MM_KSWAPD
+    if (cpu < 0) {
+      oncpu_set(mm->oncpu, NULL);
+      kswapd_stalled = 0;  /* its parked pages are back */
+    } else {
+      oncpu_set(cpu, mm);
+    }
+#endif
+    if (cpu < 0)
+      reclaim_unpark(mm->oncpu);
+    mm->oncpu = cpu;
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+}
+
+/*
+ * pg_access - get the page in ram, recording the access in its PTE.
+ * Called between mm_enter() and mm_leave(), the frame stays the page's
+ * until then.
+ */
+static int pg_access(struct mm_struct *mm, int pgn, addr_t *fpn,
+                     struct pcb_t *caller, int write)
+{
+  int ret;
+
+  if (pgn < 0 || pgn >= PAGING_MAX_PGN) {
     return -1;
   }
+
+#ifdef MM64
+  pte_t bits = PAGING_PTE_ACCESSED_MASK | (write ? PAGING_PTE_DIRTY_MASK : 0);
+#endif
+#ifdef MM_TLB
+  pte_t tlbpte;
+
+  /* A first write through a clean entry walks to set the dirty bit */
+  if (tlb_lookup(mm->asid, pgn, &tlbpte) == 0 &&
+      (!write || (tlbpte & PAGING_PTE_DIRTY_MASK))) {
+    *fpn = PAGING_FPN(tlbpte);
+    return 0;
+  }
+#endif
+
+  // Kiểm tra page đã được map chưa
+  pte_t pte = pte_get_entry(caller, pgn);
+  
+  if (PAGING_PAGE_PRESENT(pte) && !PAGING_PTE_SWAPPED(pte)) {
+#ifdef MM64
+    /* Shared pages are kept clean, a write always gets here */
+    if (write && (pte & PAGING_PTE_COW_MASK)) {
+      mm_lock(mm);
+      ret = cow_fault(caller, pgn, fpn);
+      mm_unlock(mm);
+      if (ret != 0)
+        return -1;
+      pte_set_flags(caller, pgn, bits);
+#ifdef MM_TLB
+      tlb_fill(mm->asid, pgn, pte_get_entry(caller, pgn));
+#endif
+      return 0;
+    }
+#endif
+    *fpn = PAGING_FPN(pte);
+#ifdef MM64
+    if ((pte & bits) != bits && pte_set_flags(caller, pgn, bits) == 0)
+      pte |= bits;
+#endif
+#if defined(MM64) && defined(MM_SWAP_RA)
+    /* First use of a page swapped in ahead, it is not in any TLB yet */
+    if ((pte & PAGING_PTE_READAHEAD_MASK) &&
+        pte_clear_flags(caller, pgn, PAGING_PTE_READAHEAD_MASK) == 0) {
+      pte &= ~PAGING_PTE_READAHEAD_MASK;
+      mm->ra_recent++;
+      mm->ra_hits++;
+    }
+#endif
+#ifdef MM_TLB
+    tlb_fill(mm->asid, pgn, pte);
+#endif
+    return 0;
+  }
+
+  // Page is not resident, bring it in
+  mm_lock(mm);
+  ret = pg_fault(caller, pgn, pte, fpn, write);
+  mm_unlock(mm);
+  if (ret != 0)
+    return -1;
+
+#ifdef MM64
+  pte_set_flags(caller, pgn, bits);
+#endif
+#ifdef MM_TLB
+  tlb_fill(mm->asid, pgn, pte_get_entry(caller, pgn));
+#endif
+  return 0;
+}
+
+/*pg_fault_report - print the fault counters of the run */
+void pg_fault_report(void)
+{
+  pthread_mutex_lock(&mmvm_lock);
+  log_printf("Page faults: %lu minor, %lu major, %lu pages swapped out\n",
+             nr_minflt, nr_majflt, nr_swapout);
+  log_printf("Frame reclaim: %lu pages by faulting CPUs, %lu by kswapd in %lu wakeups\n",
+             nr_direct, nr_kswapd, nr_kswapd_wake);
+#if defined(MM64) && defined(MM_SWAP_RA)
+  log_printf("Swap readahead: %lu pages, %lu used, %lu evicted unused\n",
+             nr_ra_pages, nr_ra_hits, nr_ra_wasted);
+#endif
+#ifdef MM64
+  log_printf("Fork: %lu forks sharing %lu pages, %lu copied on write, %lu kept by the last sharer\n",
+             nr_forks, nr_cow_shared, nr_cow_copied, nr_cow_reused);
+  log_printf("Zero page: %lu pages read before written, %lu of them written since\n",
+             nr_zero_mapped, nr_zero_filled);
+#endif
+#if defined(MM64) && defined(MM_KSM)
+  log_printf("KSM: %lu full scans, %lu frames saved by merging identical pages\n",
+             nr_ksm_scans, nr_ksm_merged);
+#endif
+  pthread_mutex_unlock(&mmvm_lock);
+}
+
+/*pg_reclaim_counters - pages evicted so far by faulting CPUs and by kswapd */
+void pg_reclaim_counters(unsigned long *direct, unsigned long *background)
+{
+  pthread_mutex_lock(&mmvm_lock);
+  *direct = nr_direct;
+  *background = nr_kswapd;
+  pthread_mutex_unlock(&mmvm_lock);
+}
+
+/*pg_getpage - get the page in ram */
+int pg_getpage(struct mm_struct *mm, int pgn, addr_t *fpn, struct pcb_t *caller)
+{
+  int ret;
+
+  mm_enter(mm);
+  ret = pg_access(mm, pgn, fpn, caller, 0);
+  mm_leave(mm);
+  return ret;
 }
 
 /*pg_getval - read value at given offset */
@@ -213,21 +1276,21 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
 {
   int pgn = PAGING_PGN(addr);
   int off = PAGING_OFFST(addr);
-  int fpn;
+  addr_t fpn;
+  int ret = -1;
 
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0) {
-    return -1;
-  }
+  mm_enter(mm);
+  if (pg_access(mm, pgn, &fpn, caller, 0) == 0) {
+    // Calculate physical address directly
+    addr_t phyaddr = (fpn * PAGING_PAGESZ) + off;
 
-  // Calculate physical address directly
-  int phyaddr = (fpn * PAGING_PAGESZ) + off;
-  
-  // Read directly from physical memory
-  if (MEMPHY_read(caller->krnl->mram, phyaddr, data) != 0) {
-    return -1;
+    // Read directly from physical memory
+    if (MEMPHY_read(caller->krnl->mram, phyaddr, data) == 0)
+      ret = 0;
   }
-  
-  return 0;
+  mm_leave(mm);
+
+  return ret;
 }
 
 /*pg_setval - write value to given offset */
@@ -235,21 +1298,21 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
 {
   int pgn = PAGING_PGN(addr);
   int off = PAGING_OFFST(addr);
-  int fpn;
+  addr_t fpn;
+  int ret = -1;
 
-  if (pg_getpage(mm, pgn, &fpn, caller) != 0) {
-    return -1;
-  }
+  mm_enter(mm);
+  if (pg_access(mm, pgn, &fpn, caller, 1) == 0) {
+    // Calculate physical address directly
+    addr_t phyaddr = (fpn * PAGING_PAGESZ) + off;
 
-  // Calculate physical address directly
-  int phyaddr = (fpn * PAGING_PAGESZ) + off;
-  
-  // Write directly to physical memory
-  if (MEMPHY_write(caller->krnl->mram, phyaddr, value) != 0) {
-    return -1;
+    // Write directly to physical memory
+    if (MEMPHY_write(caller->krnl->mram, phyaddr, value) == 0)
+      ret = 0;
   }
-  
-  return 0;
+  mm_leave(mm);
+
+  return ret;
 }
 
 /*__read - read value in region memory */
@@ -297,7 +1360,7 @@ int libread(struct pcb_t *proc, uint32_t source, addr_t offset, uint32_t* destin
   }
 
 #ifdef IODUMP
-  printf("libread:426\n");
+  log_printf("libread:426\n");
   print_pgtbl(proc, 0, 0);
 #endif
 
@@ -344,29 +1407,13 @@ int libwrite(struct pcb_t *proc, BYTE data, uint32_t destination, addr_t offset)
   int val = __write(proc, 0, destination, offset, data);
 
 #ifdef IODUMP
-  printf("libwrite:502\n");
+  log_printf("libwrite:502\n");
   print_pgtbl(proc, 0, 0);
 #endif
 
   return val;
 }
 
-/*find_victim_page - find victim page */
-int find_victim_page(struct mm_struct *mm, addr_t *retpgn)
-{
-  struct pgn_t *pg = mm->fifo_pgn;
-
-  if (pg == NULL) {
-    return -1;
-  }
-
-  *retpgn = pg->pgn;
-  mm->fifo_pgn = pg->pg_next;
-  free(pg);
-
-  return 0;
-}
-
 /*get_free_vmrg_area - get a free vm region */
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg)
 {
@@ -1,10 +1,23 @@
 
 #include "loader.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 static uint32_t avail_pid = 1;
+static pthread_mutex_t pid_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Processes come from the loader and from fork on the CPUs */
+static uint32_t alloc_pid(void) {
+	uint32_t pid;
+
+	pthread_mutex_lock(&pid_lock);
+	pid = avail_pid++;
+	pthread_mutex_unlock(&pid_lock);
+	return pid;
+}
 
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
@@ -12,6 +25,8 @@ static uint32_t avail_pid = 1;
 #define OPT_READ	"read"
 #define OPT_WRITE	"write"
 #define OPT_SYSCALL	"syscall"
+#define OPT_LOOP	"loop"
+#define OPT_JNZ		"jnz"
 
 static enum ins_opcode_t get_opcode(char * opt) {
 	if (!strcmp(opt, OPT_CALC)) {
@@ -26,8 +41,12 @@ static enum ins_opcode_t get_opcode(char * opt) {
 		return WRITE;
 	}else if (!strcmp(opt, OPT_SYSCALL)) {
 		return SYSCALL;
+	}else if (!strcmp(opt, OPT_LOOP)) {
+		return LOOP;
+	}else if (!strcmp(opt, OPT_JNZ)) {
+		return JNZ;
 	}else{
-		printf("get_opcode return Opcode: %s\n", opt);
+		log_printf("get_opcode return Opcode: %s\n", opt);
 		exit(1);
 	}
 }
@@ -35,8 +54,7 @@ static enum ins_opcode_t get_opcode(char * opt) {
 struct pcb_t * load(const char * path) {
 	/* Create new PCB for the new process */
 	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
+	proc->pid = alloc_pid();
 	proc->page_table =
 		(struct page_table_t*)malloc(sizeof(struct page_table_t));
 	proc->bp = PAGE_SIZE;
@@ -45,10 +63,10 @@ struct pcb_t * load(const char * path) {
 	/* Read process code from file */
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find process description at '%s'\n", path);
+		log_printf("Cannot find process description at '%s'\n", path);
 		exit(1);		
 	}
-	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
+	snprintf(proc->path, sizeof(proc->path), "%s", path);
 	char opcode[10];
 	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
 	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
@@ -93,8 +111,34 @@ struct pcb_t * load(const char * path) {
 			           &proc->code->text[i].arg_3
 			);
 			break;
+		case LOOP:
+		case JNZ:
+			fscanf(
+				file,
+				"" FORMAT_ARG " " FORMAT_ARG "\n",
+				&proc->code->text[i].arg_0,
+				&proc->code->text[i].arg_1
+			);
+			proc->code->text[i].arg_2 = 0;
+			break;
 		default:
-			printf("Opcode: %s\n", opcode);
+			log_printf("Opcode: %s\n", opcode);
+			exit(1);
+		}
+	}
+	fclose(file);
+
+	/* Branch targets are instruction indexes, reject the ones
+	 * falling outside of the code segment before running */
+	for (i = 0; i < proc->code->size; i++) {
+		struct inst_t *ins = &proc->code->text[i];
+		if (ins->opcode != LOOP && ins->opcode != JNZ)
+			continue;
+		if (ins->arg_1 >= proc->code->size ||
+		    (ins->opcode == JNZ &&
+		     ins->arg_0 >= sizeof(proc->regs) / sizeof(proc->regs[0]))) {
+			log_printf("Invalid branch at instruction %u of '%s'\n",
+				i, path);
 			exit(1);
 		}
 	}
@@ -102,5 +146,31 @@ struct pcb_t * load(const char * path) {
 	return proc;
 }
 
+struct pcb_t * dup_proc(const struct pcb_t * parent) {
+	struct pcb_t * proc = (struct pcb_t *)malloc(sizeof(struct pcb_t));
+
+	*proc = *parent;
+	proc->pid = alloc_pid();
+	proc->krnl = NULL;
+	proc->page_table =
+		(struct page_table_t*)malloc(sizeof(struct page_table_t));
+	memcpy(proc->page_table, parent->page_table, sizeof(struct page_table_t));
+
+	/* Loop counters live in the code, the child needs its own */
+	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	proc->code->size = parent->code->size;
+	proc->code->text = (struct inst_t*)malloc(
+		sizeof(struct inst_t) * parent->code->size
+	);
+	memcpy(proc->code->text, parent->code->text,
+		sizeof(struct inst_t) * parent->code->size);
 
+	return proc;
+}
 
+void unload(struct pcb_t * proc) {
+	free(proc->code->text);
+	free(proc->code);
+	free(proc->page_table);
+	free(proc);
+}
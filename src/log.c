@@ -0,0 +1,213 @@
+/*
+ * Asynchronous kernel log
+ *
+ * Each thread owns a single-producer ring of fixed size records. A
+ * global sequence number taken when a message is issued gives the total
+ * order, the writer thread always emits the record carrying the next
+ * sequence number so the merged stream matches a plain printf run.
+ */
+
+#include "log.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct log_rec {
+	uint64_t seq;
+	int len;
+	char *ext;		/* heap copy of a message over LOG_LINE_MAX */
+	char buf[LOG_LINE_MAX];
+};
+
+struct log_ring {
+	uint64_t head;		/* next record to drain, writer owned */
+	uint64_t tail;		/* next record to fill, producer owned */
+	struct log_ring *next;
+	struct log_rec rec[LOG_RING_SLOTS];
+};
+
+static struct log_ring *rings;		/* every ring ever registered */
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct log_ring *my_ring;
+static __thread int my_gen;
+static int log_gen;			/* bumped when rings are released */
+
+/* include/sched.h shadows the libc one, a zero sleep yields the same */
+static void log_relax(void)
+{
+	struct timespec ts = { 0, 0 };
+
+	nanosleep(&ts, NULL);
+}
+
+static uint64_t log_seq;		/* next sequence number to issue */
+static int log_running;
+static int log_stopping;
+static pthread_t log_writer;
+
+static struct log_ring *log_get_ring(void)
+{
+	struct log_ring *r = my_ring;
+
+	if (r != NULL && my_gen == log_gen)
+		return r;
+
+	r = calloc(1, sizeof(struct log_ring));
+	pthread_mutex_lock(&rings_lock);
+	r->next = rings;
+	__atomic_store_n(&rings, r, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&rings_lock);
+	my_ring = r;
+	my_gen = log_gen;
+	return r;
+}
+
+int log_printf(const char *fmt, ...)
+{
+	struct log_ring *r;
+	struct log_rec *rec;
+	uint64_t tail;
+	va_list ap;
+	int len;
+
+	if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+		va_start(ap, fmt);
+		len = vprintf(fmt, ap);
+		va_end(ap);
+		return len;
+	}
+
+	r = log_get_ring();
+	tail = r->tail;
+
+	/* Ring full, let the writer catch up before taking a number */
+	while (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= LOG_RING_SLOTS)
+		log_relax();
+
+	rec = &r->rec[tail & (LOG_RING_SLOTS - 1)];
+	rec->seq = __atomic_fetch_add(&log_seq, 1, __ATOMIC_ACQ_REL);
+
+	va_start(ap, fmt);
+	len = vsnprintf(rec->buf, LOG_LINE_MAX, fmt, ap);
+	va_end(ap);
+
+	rec->ext = NULL;
+	if (len >= LOG_LINE_MAX) {
+		rec->ext = malloc(len + 1);
+		va_start(ap, fmt);
+		vsnprintf(rec->ext, len + 1, fmt, ap);
+		va_end(ap);
+	}
+	rec->len = len;
+
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return len;
+}
+
+/*
+ * Emit the record numbered [seq] if some ring has it at its head, then
+ * keep going on that ring while it holds the following numbers. Returns
+ * how many records went out.
+ */
+static int log_drain(uint64_t seq)
+{
+	struct log_ring *r;
+	int n = 0;
+
+	for (r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+		uint64_t head = r->head;
+		uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		struct log_rec *rec;
+
+		if (head == tail || r->rec[head & (LOG_RING_SLOTS - 1)].seq != seq)
+			continue;
+
+		do {
+			rec = &r->rec[head & (LOG_RING_SLOTS - 1)];
+			if (rec->ext != NULL) {
+				fwrite(rec->ext, 1, rec->len, stdout);
+				free(rec->ext);
+			} else if (rec->len > 0) {
+				fwrite(rec->buf, 1, rec->len, stdout);
+			}
+			head++;
+			n++;
+		} while (head != tail &&
+			 r->rec[head & (LOG_RING_SLOTS - 1)].seq == seq + n);
+
+		__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+		break;
+	}
+
+	return n;
+}
+
+static void *log_routine(void *args)
+{
+	struct timespec idle = { 0, 20000 };
+	uint64_t next = 0;
+
+	while (1) {
+		if (next < __atomic_load_n(&log_seq, __ATOMIC_ACQUIRE)) {
+			int n = log_drain(next);
+
+			if (n == 0)
+				log_relax(); /* number taken, not yet published */
+			next += n;
+			continue;
+		}
+
+		fflush(stdout);
+		if (__atomic_load_n(&log_stopping, __ATOMIC_ACQUIRE) &&
+		    next == __atomic_load_n(&log_seq, __ATOMIC_ACQUIRE))
+			break;
+		nanosleep(&idle, NULL);
+	}
+
+	return NULL;
+}
+
+void log_start(void)
+{
+	static int registered;
+
+	if (log_running)
+		return;
+
+	fflush(stdout);
+	log_stopping = 0;
+	pthread_create(&log_writer, NULL, log_routine, NULL);
+	__atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+
+	/* exit() from any thread still gets the buffered messages out */
+	if (!registered) {
+		atexit(log_stop);
+		registered = 1;
+	}
+}
+
+/* Producers must be done logging before the rings are released */
+void log_stop(void)
+{
+	struct log_ring *r;
+
+	if (!__atomic_exchange_n(&log_running, 0, __ATOMIC_ACQ_REL))
+		return;
+
+	__atomic_store_n(&log_stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(log_writer, NULL);
+
+	/* Rings of exited threads are released with the writer */
+	pthread_mutex_lock(&rings_lock);
+	while (rings != NULL) {
+		r = rings;
+		rings = r->next;
+		free(r);
+	}
+	log_seq = 0;
+	log_gen++;
+	pthread_mutex_unlock(&rings_lock);
+}
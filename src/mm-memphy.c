@@ -1 +1,590 @@
+/*
+ * Copyright (C) 2026 pdnguyen of HCMC University of Technology VNU-HCM
+ */
 
+/* LamiaAtrium release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+/*
+ * PAGING based Memory Management
+ * Memory physical module mm/mm-memphy.c
+ */
+
+#include "mm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Guards the frame bitmaps of every device, RAM is shared by all CPUs */
+static pthread_mutex_t memphy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  MEMPHY_mv_csr - move MEMPHY cursor
+ *  @mp: memphy struct
+ *  @offset: offset
+ */
+int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset)
+{
+   int numstep = 0;
+
+   mp->cursor = 0;
+   while (numstep < offset && numstep < mp->maxsz)
+   {
+      /* Traverse sequentially */
+      mp->cursor = (mp->cursor + 1) % mp->maxsz;
+      numstep++;
+   }
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_seq_read - read MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @value: obtained value
+ */
+int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
+{
+   if (mp == NULL)
+      return -1;
+
+   if (mp->rdmflg)
+      return -1; /* Not compatible mode for sequential access */
+
+   MEMPHY_mv_csr(mp, addr);
+   *value = (BYTE)mp->storage[addr];
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_read read MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @value: obtained value
+ */
+int MEMPHY_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
+{
+   if (mp == NULL)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      *value = mp->storage[addr];
+      return 0;
+   }
+   else /* Sequential access device */
+      return MEMPHY_seq_read(mp, addr, value);
+}
+
+/*
+ *  MEMPHY_seq_write - write MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @data: written data
+ */
+int MEMPHY_seq_write(struct memphy_struct *mp, addr_t addr, BYTE value)
+{
+   if (mp == NULL)
+      return -1;
+
+   if (mp->rdmflg)
+      return -1; /* Not compatible mode for sequential access */
+
+   MEMPHY_mv_csr(mp, addr);
+   mp->storage[addr] = value;
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write-write MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: address
+ *  @data: written data
+ */
+int MEMPHY_write(struct memphy_struct *mp, addr_t addr, BYTE data)
+{
+   if (mp == NULL)
+      return -1;
+
+   if (mp->rdmflg)
+   {
+      mp->storage[addr] = data;
+      return 0;
+   }
+   else /* Sequential access device */
+      return MEMPHY_seq_write(mp, addr, data);
+}
+
+/* A sequential device seeks once per page and then streams, random access
+ * devices copy whole pages with memcpy, which glibc vectorizes */
+static int page_ok(struct memphy_struct *mp, addr_t fpn)
+{
+   return mp != NULL && (fpn + 1) * PAGING_PAGESZ <= (addr_t)mp->maxsz;
+}
+
+static void seq_seek(struct memphy_struct *mp, addr_t fpn)
+{
+   MEMPHY_mv_csr(mp, fpn * PAGING_PAGESZ);
+   mp->cursor = (mp->cursor + PAGING_PAGESZ) % mp->maxsz;
+}
+
+/*
+ *  MEMPHY_read_page - read frame [fpn] into [buf]
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @buf: PAGING_PAGESZ bytes
+ */
+int MEMPHY_read_page(struct memphy_struct *mp, addr_t fpn, BYTE *buf)
+{
+   if (!page_ok(mp, fpn))
+      return -1;
+
+   if (!mp->rdmflg)
+      seq_seek(mp, fpn);
+   memcpy(buf, mp->storage + fpn * PAGING_PAGESZ, PAGING_PAGESZ);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_page - write [buf] into frame [fpn]
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @buf: PAGING_PAGESZ bytes
+ */
+int MEMPHY_write_page(struct memphy_struct *mp, addr_t fpn, const BYTE *buf)
+{
+   if (!page_ok(mp, fpn))
+      return -1;
+
+   if (!mp->rdmflg)
+      seq_seek(mp, fpn);
+   memcpy(mp->storage + fpn * PAGING_PAGESZ, buf, PAGING_PAGESZ);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_copy_page - copy frame [srcfpn] of [mpsrc] to [dstfpn] of [mpdst]
+ *  @mpsrc: source memphy
+ *  @srcfpn: source frame
+ *  @mpdst: destination memphy
+ *  @dstfpn: destination frame
+ */
+int MEMPHY_copy_page(struct memphy_struct *mpsrc, addr_t srcfpn,
+                     struct memphy_struct *mpdst, addr_t dstfpn)
+{
+   BYTE buf[PAGING_PAGESZ];
+
+   if (!page_ok(mpsrc, srcfpn) || !page_ok(mpdst, dstfpn))
+      return -1;
+
+   if (mpsrc->rdmflg && mpdst->rdmflg)
+   {
+      if (mpsrc != mpdst || srcfpn != dstfpn)
+         memcpy(mpdst->storage + dstfpn * PAGING_PAGESZ,
+                mpsrc->storage + srcfpn * PAGING_PAGESZ, PAGING_PAGESZ);
+      return 0;
+   }
+
+   MEMPHY_read_page(mpsrc, srcfpn, buf);
+   return MEMPHY_write_page(mpdst, dstfpn, buf);
+}
+
+/*
+ *  MEMPHY_zero_page - clear frame [fpn]
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ */
+int MEMPHY_zero_page(struct memphy_struct *mp, addr_t fpn)
+{
+   if (!page_ok(mp, fpn))
+      return -1;
+
+   if (!mp->rdmflg)
+      seq_seek(mp, fpn);
+   memset(mp->storage + fpn * PAGING_PAGESZ, 0, PAGING_PAGESZ);
+
+   return 0;
+}
+
+/*
+ * Frames are tracked in a bitmap, a set bit is a frame in use. A second
+ * bitmap marks the words with no frame left, so the search for a free
+ * frame skips full words 64 at a time. Nothing is allocated per frame.
+ */
+#define FP_BITS (8 * (int)sizeof(unsigned long))
+
+/* Bits of word [w] covering frames [base, end) */
+static inline unsigned long fp_mask(addr_t base, addr_t end, addr_t w)
+{
+   unsigned long mask = ~0UL;
+
+   if (w == base / FP_BITS)
+      mask &= ~0UL << (base % FP_BITS);
+   if ((w + 1) * FP_BITS > end)
+      mask &= ~0UL >> ((w + 1) * FP_BITS - end);
+   return mask;
+}
+
+/* Note in fp_full whether word [w] has a free frame left */
+static inline void fp_update_full(struct memphy_struct *mp, int w)
+{
+   unsigned long bit = 1UL << (w % FP_BITS);
+
+   if (mp->fp_bitmap[w] == ~0UL)
+      mp->fp_full[w / FP_BITS] |= bit;
+   else
+      mp->fp_full[w / FP_BITS] &= ~bit;
+}
+
+/* 1 when the frames [base, base + nfp) are all free, memphy_lock held */
+static int fp_run_free(struct memphy_struct *mp, addr_t base, int nfp)
+{
+   addr_t end = base + nfp;
+   addr_t w;
+
+   for (w = base / FP_BITS; w * FP_BITS < end; w++)
+      if (mp->fp_bitmap[w] & fp_mask(base, end, w))
+         return 0;
+   return 1;
+}
+
+/* Mark the frames [base, base + nfp) in use, memphy_lock held */
+static void fp_run_take(struct memphy_struct *mp, addr_t base, int nfp)
+{
+   addr_t end = base + nfp;
+   addr_t w;
+
+   for (w = base / FP_BITS; w * FP_BITS < end; w++)
+   {
+      mp->fp_bitmap[w] |= fp_mask(base, end, w);
+      fp_update_full(mp, w);
+   }
+   mp->free_cnt -= nfp;
+}
+
+/*
+ * Take a free frame, memphy_lock held. The search starts at the hint and
+ * wraps around, so a frame just given back is the next one taken while
+ * its words are still in cache.
+ */
+static int fp_take(struct memphy_struct *mp, addr_t *retfpn)
+{
+   int nfull = (mp->fp_words + FP_BITS - 1) / FP_BITS;
+   unsigned long word;
+   int i, s, w;
+
+   if (mp->free_cnt == 0)
+      return -1;
+
+   for (i = 0, s = mp->fp_hint; i < nfull; i++, s = (s + 1 < nfull) ? s + 1 : 0)
+   {
+      word = ~mp->fp_full[s];
+      if (word == 0)
+         continue;
+
+      w = s * FP_BITS + __builtin_ctzl(word);
+      word = ~mp->fp_bitmap[w];
+      mp->fp_bitmap[w] |= word & -word;
+      fp_update_full(mp, w);
+      mp->fp_hint = s;
+      mp->free_cnt--;
+      *retfpn = (addr_t)w * FP_BITS + __builtin_ctzl(word);
+      return 0;
+   }
+   return -1;
+}
+
+/* Give frame [fpn] back, memphy_lock held. -1 when it is not in use */
+static int fp_give(struct memphy_struct *mp, addr_t fpn)
+{
+   int w = fpn / FP_BITS;
+   unsigned long bit = 1UL << (fpn % FP_BITS);
+
+   /* Bits past the last frame are set but never were a frame */
+   if (fpn >= (addr_t)(mp->maxsz / PAGING_PAGESZ) || !(mp->fp_bitmap[w] & bit))
+      return -1;
+
+   mp->fp_bitmap[w] &= ~bit;
+   mp->fp_full[w / FP_BITS] &= ~(1UL << (w % FP_BITS));
+   mp->fp_hint = w / FP_BITS;
+   mp->free_cnt++;
+   return 0;
+}
+
+/*
+ *  MEMPHY_format-format MEMPHY device
+ *  @mp: memphy struct
+ */
+int MEMPHY_format(struct memphy_struct *mp, int pagesz)
+{
+   /* This setting come with fixed constant PAGESZ */
+   int numfp = mp->maxsz / pagesz;
+   int nfull;
+
+   mp->fp_bitmap = NULL;
+   mp->fp_full = NULL;
+   mp->fp_words = 0;
+   mp->fp_hint = 0;
+   mp->free_cnt = 0;
+   if (numfp <= 0)
+      return -1;
+
+   /* Both bitmaps in one block, fp_full after the frame bits */
+   mp->fp_words = (numfp + FP_BITS - 1) / FP_BITS;
+   nfull = (mp->fp_words + FP_BITS - 1) / FP_BITS;
+   mp->fp_bitmap = calloc(mp->fp_words + nfull, sizeof(unsigned long));
+   mp->fp_full = mp->fp_bitmap + mp->fp_words;
+   mp->free_cnt = numfp;
+
+   /* Bits past the last frame and word stay set, they are never free */
+   if (numfp % FP_BITS)
+      mp->fp_bitmap[mp->fp_words - 1] = ~0UL << (numfp % FP_BITS);
+   if (mp->fp_words % FP_BITS)
+      mp->fp_full[nfull - 1] = ~0UL << (mp->fp_words % FP_BITS);
+
+   return 0;
+}
+
+int MEMPHY_get_freefp(struct memphy_struct *mp, addr_t *retfpn)
+{
+   int ret;
+
+   pthread_mutex_lock(&memphy_lock);
+   ret = fp_take(mp, retfpn);
+   pthread_mutex_unlock(&memphy_lock);
+
+   return ret;
+}
+
+/*
+ *  MEMPHY_get_freefp_range - take [nfp] contiguous free frames
+ *  @mp: memphy struct
+ *  @nfp: number of frames, the run is aligned on it
+ *  @retfpn: first frame of the run
+ */
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nfp, addr_t *retfpn)
+{
+   int numfp = mp->maxsz / PAGING_PAGESZ;
+   addr_t base;
+
+   if (nfp <= 0 || nfp > numfp)
+      return -1;
+
+   pthread_mutex_lock(&memphy_lock);
+   if (mp->free_cnt < nfp)
+   {
+      pthread_mutex_unlock(&memphy_lock);
+      return -1;
+   }
+
+   for (base = 0; base + nfp <= numfp; base += nfp)
+      if (fp_run_free(mp, base, nfp))
+         break;
+
+   if (base + nfp > numfp)
+   {
+      pthread_mutex_unlock(&memphy_lock);
+      return -1; /* Too fragmented */
+   }
+
+   fp_run_take(mp, base, nfp);
+   pthread_mutex_unlock(&memphy_lock);
+
+   *retfpn = base;
+   return 0;
+}
+
+/*
+ *  MEMPHY_count_freefp - number of free frames
+ *  @mp: memphy struct
+ */
+int MEMPHY_count_freefp(struct memphy_struct *mp)
+{
+   int n;
+
+   pthread_mutex_lock(&memphy_lock);
+   n = mp->free_cnt;
+   pthread_mutex_unlock(&memphy_lock);
+
+   return n;
+}
+
+int MEMPHY_dump(struct memphy_struct *mp)
+{
+   /*TODO dump memphy contnt mp->storage
+    *     for tracing the memory content
+    */
+   return 0;
+}
+
+int MEMPHY_put_freefp(struct memphy_struct *mp, addr_t fpn)
+{
+   int ret;
+
+   pthread_mutex_lock(&memphy_lock);
+   ret = fp_give(mp, fpn);
+   pthread_mutex_unlock(&memphy_lock);
+
+   return ret;
+}
+
+/*
+ *  MEMPHY_get_zerofp - take a reference on the shared zero frame
+ *  @mp: memphy struct
+ *  @retfpn: the zero frame
+ *
+ *  The first reference takes a free frame and clears it,
+ *  -1 when no frame is free for it.
+ */
+int MEMPHY_get_zerofp(struct memphy_struct *mp, addr_t *retfpn)
+{
+   pthread_mutex_lock(&memphy_lock);
+   if (mp->zero_refs == 0)
+   {
+      if (fp_take(mp, &mp->zero_fpn) != 0)
+      {
+         pthread_mutex_unlock(&memphy_lock);
+         return -1;
+      }
+      MEMPHY_zero_page(mp, mp->zero_fpn);
+   }
+   mp->zero_refs++;
+   *retfpn = mp->zero_fpn;
+   pthread_mutex_unlock(&memphy_lock);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_put_zerofp - drop a reference on the shared zero frame, the
+ *  last one frees the frame
+ *  @mp: memphy struct
+ */
+int MEMPHY_put_zerofp(struct memphy_struct *mp)
+{
+   pthread_mutex_lock(&memphy_lock);
+   if (mp->zero_refs > 0 && --mp->zero_refs == 0)
+      fp_give(mp, mp->zero_fpn);
+   pthread_mutex_unlock(&memphy_lock);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_is_zerofp - 1 when [fpn] is the shared zero frame of [mp]
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ */
+int MEMPHY_is_zerofp(struct memphy_struct *mp, addr_t fpn)
+{
+   int ret;
+
+   pthread_mutex_lock(&memphy_lock);
+   ret = mp->zero_refs > 0 && fpn == mp->zero_fpn;
+   pthread_mutex_unlock(&memphy_lock);
+
+   return ret;
+}
+
+/* Common part of the init, [mp]->storage is in place */
+static void memphy_setup(struct memphy_struct *mp, addr_t max_size, int randomflg)
+{
+   mp->maxsz = max_size;
+
+   MEMPHY_format(mp, PAGING_PAGESZ);
+   mp->zero_fpn = 0;
+   mp->zero_refs = 0;
+
+   mp->rdmflg = (randomflg != 0) ? 1 : 0;
+
+   if (!mp->rdmflg) /* Not Ramdom acess device, then it serial device*/
+      mp->cursor = 0;
+}
+
+/*
+ *  Init MEMPHY struct
+ *
+ *  The storage comes zeroed from calloc, which leaves large devices to
+ *  be mapped in by the host as they are used.
+ */
+int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
+{
+   mp->storage = (BYTE *)calloc(max_size ? max_size : 1, sizeof(BYTE));
+   mp->mapped = 0;
+   memphy_setup(mp, max_size, randomflg);
+
+   return 0;
+}
+
+/*
+ *  init_memphy_file - Init MEMPHY struct on the host file [path]
+ *  @keep: leave the file with the device contents after the run
+ *
+ *  The file is created empty and mapped shared, so the host pages it in
+ *  and out on its own and the device takes no memory until it is used.
+ *  A file not kept is unlinked right away, it goes with the mapping.
+ */
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg,
+                     const char *path, int keep)
+{
+   void *storage;
+   int fd;
+
+   if (max_size == 0)
+      return init_memphy(mp, max_size, randomflg);
+
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0)
+      return -1;
+   if (ftruncate(fd, max_size) != 0)
+   {
+      close(fd);
+      unlink(path);
+      return -1;
+   }
+   storage = mmap(NULL, max_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (storage == MAP_FAILED)
+   {
+      unlink(path);
+      return -1;
+   }
+   if (!keep)
+      unlink(path);
+
+   mp->storage = (BYTE *)storage;
+   mp->mapped = 1;
+   memphy_setup(mp, max_size, randomflg);
+
+   return 0;
+}
+
+/*
+ *  free_memphy - Release the storage and frame bitmap of [mp], a kept
+ *  backing file is written back
+ */
+void free_memphy(struct memphy_struct *mp)
+{
+   free(mp->fp_bitmap);
+   mp->fp_bitmap = NULL;
+   mp->fp_full = NULL;
+   mp->fp_words = 0;
+   mp->free_cnt = 0;
+
+   if (mp->mapped)
+      munmap(mp->storage, mp->maxsz);
+   else
+      free(mp->storage);
+   mp->storage = NULL;
+}
@@ -0,0 +1,589 @@
+/*
+ * Page reclaim
+ *
+ * The frame table holds one entry per RAM frame. Tracked frames sit on
+ * one of two lists threaded through the table by frame number, oldest
+ * page at the head. Only the two list policy uses the active list, the
+ * others keep every frame on the inactive one.
+ *
+ * fifo   evicts the head.
+ * clock  looks at the accessed bit of the head page first: a set bit is
+ *        cleared and the page goes round to the tail for a second
+ *        chance, which is the clock hand moving past it. This is the
+ *        usual approximation of LRU.
+ * 2q     needs a page to be referenced twice before it is protected.
+ *        New pages enter the inactive list, a page seen referenced there
+ *        moves to the active list and the active list drains back into
+ *        the inactive one whenever it grows past it, so a scan touching
+ *        each page once never displaces the hot set.
+ * ws     stamps each page with the reclaim clock when its accessed bit
+ *        is seen and evicts the first page idle for longer than the
+ *        working set window, falling back to the longest idle one. The
+ *        clock ticks once per tracked page, i.e. per fault.
+ *
+ * A frame shared by fork or same page merging keeps its first mapper as
+ * owner, the others hang off the entry. A shared victim leaves all its
+ * mappers at once, so it is passed over while any of them runs on
+ * another CPU. kswapd holds every running process off its pages while
+ * it looks for a victim, so nothing is busy for it.
+ *
+ * A frame passed over because a mapper runs on CPU c is parked on a
+ * list of that CPU and left out of the scans until the process there
+ * is switched out, so busy pages are not rescanned for every victim.
+ */
+
+#include "reclaim.h"
+#include "mm.h"
+#ifdef MM64
+#include "mm64.h"
+#endif
+#include "log.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct frame_map {
+	struct pcb_t *owner;
+	addr_t pgn;
+	struct frame_map *next;
+};
+
+struct frame_ent {
+	struct pcb_t *owner;	/* NULL when not tracked */
+	addr_t pgn;
+	int mapcount;		/* owner and the mappers on maps */
+	struct frame_map *maps;
+	int prev, next;		/* list links, -1 terminated */
+	int lru;		/* list the frame is on */
+	int home;		/* list a parked frame goes back to */
+	unsigned long stamp;	/* reclaim clock at the last seen reference */
+};
+
+enum { LRU_INACTIVE, LRU_ACTIVE, NR_LRU };	/* parked lists follow */
+
+struct frame_list {
+	int head, tail;
+	int len;
+};
+
+struct reclaim_ops {
+	const char *name;
+	/* Unlink the frame to evict for [caller], -1 when none fits */
+	int (*select)(struct pcb_t *caller);
+};
+
+int reclaim_policy = RECLAIM_CLOCK;
+
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct frame_ent *frames;
+static struct frame_list lists[NR_LRU];
+static struct frame_list *parked;	/* per CPU, lru NR_LRU + cpu */
+static int nr_parked_cpus;
+static int nr_frames;
+static int nr_tracked;
+static unsigned long vclock;	/* ticks on every tracked page */
+static unsigned long ws_window;
+
+/* Work done choosing victims, under frame_lock */
+static unsigned long nr_scanned, nr_rotated, nr_selected, nr_parked;
+
+static struct frame_list *list_of(int lru)
+{
+	return (lru < NR_LRU) ? &lists[lru] : &parked[lru - NR_LRU];
+}
+
+static void list_del(int fpn)
+{
+	struct frame_ent *f = &frames[fpn];
+	struct frame_list *l = list_of(f->lru);
+
+	if (f->prev >= 0)
+		frames[f->prev].next = f->next;
+	else
+		l->head = f->next;
+	if (f->next >= 0)
+		frames[f->next].prev = f->prev;
+	else
+		l->tail = f->prev;
+	f->prev = f->next = -1;
+	l->len--;
+}
+
+static void list_add_tail(int fpn, int lru)
+{
+	struct frame_ent *f = &frames[fpn];
+	struct frame_list *l = list_of(lru);
+
+	f->lru = lru;
+	f->prev = l->tail;
+	f->next = -1;
+	if (l->tail >= 0)
+		frames[l->tail].next = fpn;
+	else
+		l->head = fpn;
+	l->tail = fpn;
+	l->len++;
+}
+
+static void list_add_head(int fpn, int lru)
+{
+	struct frame_ent *f = &frames[fpn];
+	struct frame_list *l = list_of(lru);
+
+	f->lru = lru;
+	f->prev = -1;
+	f->next = l->head;
+	if (l->head >= 0)
+		frames[l->head].prev = fpn;
+	else
+		l->tail = fpn;
+	l->head = fpn;
+	l->len++;
+}
+
+/* Move [fpn] to the tail of [lru], counted as a page passed over */
+static void rotate(int fpn, int lru)
+{
+	list_del(fpn);
+	list_add_tail(fpn, lru);
+	nr_rotated++;
+}
+
+/* Set [fpn] aside until the process running on [cpu] is switched out */
+static void park(int fpn, int cpu)
+{
+	int i;
+
+	if (cpu >= nr_parked_cpus) {
+		parked = realloc(parked, (cpu + 1) * sizeof(struct frame_list));
+		for (i = nr_parked_cpus; i <= cpu; i++) {
+			parked[i].head = parked[i].tail = -1;
+			parked[i].len = 0;
+		}
+		nr_parked_cpus = cpu + 1;
+	}
+	frames[fpn].home = frames[fpn].lru;
+	list_del(fpn);
+	list_add_tail(fpn, NR_LRU + cpu);
+	nr_rotated++;
+	nr_parked++;
+}
+
+/*
+ * Put the frames parked on [cpu] back in front of their lists, they are
+ * the oldest there. ws stamps the pages it meets, so it takes them at
+ * the tail where they do not hide the idle pages.
+ */
+static void unpark(int cpu)
+{
+	int fpn;
+
+	if (cpu < 0 || cpu >= nr_parked_cpus)
+		return;
+	while ((fpn = parked[cpu].tail) >= 0) {
+		list_del(fpn);
+		if (reclaim_policy == RECLAIM_WS)
+			list_add_tail(fpn, frames[fpn].home);
+		else
+			list_add_head(fpn, frames[fpn].home);
+	}
+}
+
+static int running(struct pcb_t *owner, struct pcb_t *caller)
+{
+	return caller != NULL && owner != caller && owner->krnl->mm->oncpu >= 0;
+}
+
+/*
+ * A mapper running elsewhere may hold the translation right now. Returns
+ * the CPU of the first one found, -1 when the frame may be evicted.
+ */
+static int busy(int fpn, struct pcb_t *caller)
+{
+	struct frame_map *m;
+
+	if (running(frames[fpn].owner, caller))
+		return frames[fpn].owner->krnl->mm->oncpu;
+	for (m = frames[fpn].maps; m != NULL; m = m->next)
+		if (running(m->owner, caller))
+			return m->owner->krnl->mm->oncpu;
+	return -1;
+}
+
+/* Test and clear the accessed bit of the page in [fpn] */
+static int referenced(int fpn)
+{
+#ifdef MM64
+	struct frame_ent *f = &frames[fpn];
+
+	if (pte_get_entry(f->owner, f->pgn) & PAGING_PTE_ACCESSED_MASK) {
+		pte_clear_flags(f->owner, f->pgn, PAGING_PTE_ACCESSED_MASK);
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+static int fifo_select(struct pcb_t *caller)
+{
+	struct frame_list *l = &lists[LRU_INACTIVE];
+	int scan, cur, cpu;
+
+	for (scan = 0; scan < l->len; scan++) {
+		cur = l->head;
+		nr_scanned++;
+		if ((cpu = busy(cur, caller)) >= 0) {
+			park(cur, cpu);
+			scan--;	/* off the list, the bound shrinks instead */
+			continue;
+		}
+		list_del(cur);
+		return cur;
+	}
+	return -1;
+}
+
+static int clock_select(struct pcb_t *caller)
+{
+	struct frame_list *l = &lists[LRU_INACTIVE];
+	int scan, cur, cpu;
+
+	/* Two rounds over the frames left give every page its second chance */
+	for (scan = 0; scan < 2 * l->len; scan++) {
+		cur = l->head;
+		nr_scanned++;
+		if ((cpu = busy(cur, caller)) >= 0) {
+			park(cur, cpu);
+			scan--;	/* off the list, the bound shrinks instead */
+			continue;
+		}
+		if (referenced(cur)) {
+			rotate(cur, LRU_INACTIVE);
+			continue;
+		}
+		list_del(cur);
+		return cur;
+	}
+	return -1;
+}
+
+static int twoq_select(struct pcb_t *caller)
+{
+	struct frame_list *inactive = &lists[LRU_INACTIVE];
+	struct frame_list *active = &lists[LRU_ACTIVE];
+	int scan, cur, cpu;
+
+	for (scan = 2 * nr_tracked; scan > 0; scan--) {
+		if (inactive->len == 0 && active->len == 0)
+			break;	/* all parked */
+		nr_scanned++;
+
+		/* Keep the active list no longer than the inactive one */
+		if (active->len > inactive->len || inactive->len == 0) {
+			cur = active->head;
+			/* Its walk cache and PTE bits are the mapper's own */
+			if ((cpu = busy(cur, caller)) >= 0) {
+				park(cur, cpu);
+				continue;
+			}
+			rotate(cur, referenced(cur) ? LRU_ACTIVE : LRU_INACTIVE);
+			continue;
+		}
+
+		cur = inactive->head;
+		if ((cpu = busy(cur, caller)) >= 0) {
+			park(cur, cpu);
+			continue;
+		}
+		if (referenced(cur)) {
+			rotate(cur, LRU_ACTIVE);	/* second reference */
+			continue;
+		}
+		list_del(cur);
+		return cur;
+	}
+	return -1;
+}
+
+static int ws_select(struct pcb_t *caller)
+{
+	struct frame_list *l = &lists[LRU_INACTIVE];
+	int scan, cur, cpu, oldest = -1;
+
+	for (scan = 0; scan < 2 * l->len; scan++) {
+		cur = l->head;
+		nr_scanned++;
+		if ((cpu = busy(cur, caller)) >= 0) {
+			park(cur, cpu);
+			scan--;	/* off the list, the bound shrinks instead */
+			continue;
+		}
+		if (referenced(cur)) {
+			frames[cur].stamp = vclock;
+			rotate(cur, LRU_INACTIVE);
+			continue;
+		}
+		if (vclock - frames[cur].stamp > ws_window) {
+			list_del(cur);
+			return cur;	/* out of the working set */
+		}
+		if (oldest < 0 || frames[cur].stamp < frames[oldest].stamp)
+			oldest = cur;
+		rotate(cur, LRU_INACTIVE);
+	}
+
+	/* Everything is in the working set, shrink it from the idle end */
+	if (oldest >= 0)
+		list_del(oldest);
+	return oldest;
+}
+
+static const struct reclaim_ops policies[] = {
+	[RECLAIM_FIFO] = { "fifo", fifo_select },
+	[RECLAIM_CLOCK] = { "clock", clock_select },
+	[RECLAIM_2Q] = { "2q", twoq_select },
+	[RECLAIM_WS] = { "ws", ws_select },
+};
+
+int reclaim_set_policy(const char *name)
+{
+	int i;
+
+	for (i = 0; i < RECLAIM_NR_POLICIES; i++) {
+		if (strcmp(name, policies[i].name) == 0) {
+			reclaim_policy = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char *reclaim_policy_name(int policy)
+{
+	if (policy < 0 || policy >= RECLAIM_NR_POLICIES)
+		return "?";
+	return policies[policy].name;
+}
+
+void reclaim_init(int nframes)
+{
+	int i;
+
+	struct frame_map *m;
+
+	pthread_mutex_lock(&frame_lock);
+	for (i = 0; i < nr_frames; i++) {
+		while ((m = frames[i].maps) != NULL) {
+			frames[i].maps = m->next;
+			free(m);
+		}
+	}
+	free(frames);
+	frames = calloc(nframes, sizeof(struct frame_ent));
+	for (i = 0; i < nframes; i++)
+		frames[i].prev = frames[i].next = -1;
+	for (i = 0; i < NR_LRU; i++) {
+		lists[i].head = lists[i].tail = -1;
+		lists[i].len = 0;
+	}
+	free(parked);
+	parked = NULL;
+	nr_parked_cpus = 0;
+	nr_frames = nframes;
+	nr_tracked = 0;
+	vclock = 0;
+	ws_window = nframes / 2;
+	nr_scanned = nr_rotated = nr_selected = nr_parked = 0;
+	pthread_mutex_unlock(&frame_lock);
+}
+
+void reclaim_track(struct pcb_t *owner, addr_t fpn, addr_t pgn)
+{
+	struct frame_map *m;
+
+	if (fpn >= (addr_t)nr_frames)
+		return;
+
+	pthread_mutex_lock(&frame_lock);
+	if (frames[fpn].owner != NULL)
+		list_del(fpn);
+	else
+		nr_tracked++;
+	frames[fpn].owner = owner;
+	frames[fpn].pgn = pgn;
+	frames[fpn].mapcount = 1;
+	for (m = frames[fpn].maps; m != NULL; m = m->next)
+		frames[fpn].mapcount++;	/* a victim put back */
+	frames[fpn].stamp = ++vclock;
+	list_add_tail(fpn, LRU_INACTIVE);
+	pthread_mutex_unlock(&frame_lock);
+}
+
+void reclaim_share(addr_t fpn, struct pcb_t *owner, addr_t pgn)
+{
+	struct frame_map *m;
+
+	if (fpn >= (addr_t)nr_frames)
+		return;
+
+	pthread_mutex_lock(&frame_lock);
+	if (frames[fpn].owner != NULL) {
+		m = malloc(sizeof(struct frame_map));
+		m->owner = owner;
+		m->pgn = pgn;
+		m->next = frames[fpn].maps;
+		frames[fpn].maps = m;
+		frames[fpn].mapcount++;
+	}
+	pthread_mutex_unlock(&frame_lock);
+}
+
+int reclaim_unmap(addr_t fpn, struct pcb_t *owner)
+{
+	struct frame_ent *f;
+	struct frame_map *m, **pm;
+	int left;
+
+	if (fpn >= (addr_t)nr_frames)
+		return 0;
+
+	pthread_mutex_lock(&frame_lock);
+	f = &frames[fpn];
+	if (f->owner == NULL) {
+		pthread_mutex_unlock(&frame_lock);
+		return 0;
+	}
+
+	if (f->owner == owner) {
+		/* The next mapper takes the frame over */
+		m = f->maps;
+		if (m != NULL) {
+			f->owner = m->owner;
+			f->pgn = m->pgn;
+			f->maps = m->next;
+			free(m);
+		}
+	} else {
+		for (pm = &f->maps; *pm != NULL; pm = &(*pm)->next) {
+			if ((*pm)->owner == owner) {
+				m = *pm;
+				*pm = m->next;
+				free(m);
+				break;
+			}
+		}
+	}
+
+	left = --f->mapcount;
+	if (left == 0) {
+		list_del(fpn);
+		f->owner = NULL;
+		nr_tracked--;
+	}
+	pthread_mutex_unlock(&frame_lock);
+	return left;
+}
+
+int reclaim_mapcount(addr_t fpn)
+{
+	int n;
+
+	if (fpn >= (addr_t)nr_frames)
+		return 0;
+
+	pthread_mutex_lock(&frame_lock);
+	n = (frames[fpn].owner != NULL) ? frames[fpn].mapcount : 0;
+	pthread_mutex_unlock(&frame_lock);
+	return n;
+}
+
+int reclaim_maps(addr_t fpn, struct pcb_t **owner, addr_t *pgn, int max)
+{
+	struct frame_map *m;
+	int n;
+
+	if (fpn >= (addr_t)nr_frames)
+		return 0;
+
+	pthread_mutex_lock(&frame_lock);
+	if (frames[fpn].owner == NULL) {
+		pthread_mutex_unlock(&frame_lock);
+		return 0;
+	}
+	n = frames[fpn].mapcount;
+	if (n <= max) {
+		owner[0] = frames[fpn].owner;
+		pgn[0] = frames[fpn].pgn;
+		for (n = 1, m = frames[fpn].maps; m != NULL; n++, m = m->next) {
+			owner[n] = m->owner;
+			pgn[n] = m->pgn;
+		}
+	}
+	pthread_mutex_unlock(&frame_lock);
+	return n;
+}
+
+int reclaim_victim(struct pcb_t *caller, struct pcb_t **owner,
+		   addr_t *pgn, addr_t *fpn)
+{
+	int cur;
+
+	pthread_mutex_lock(&frame_lock);
+	/* Pages parked for the caller's CPU are its own, they may go now */
+	if (caller != NULL)
+		unpark(caller->krnl->mm->oncpu);
+	cur = (nr_tracked > 0) ? policies[reclaim_policy].select(caller) : -1;
+	if (cur < 0) {
+		pthread_mutex_unlock(&frame_lock);
+		return -1;
+	}
+
+	*owner = frames[cur].owner;
+	*pgn = frames[cur].pgn;
+	*fpn = cur;
+	frames[cur].owner = NULL;
+	frames[cur].mapcount = 0;
+	nr_tracked--;
+	nr_selected++;
+	pthread_mutex_unlock(&frame_lock);
+	return 0;
+}
+
+void reclaim_unpark(int cpu)
+{
+	pthread_mutex_lock(&frame_lock);
+	unpark(cpu);
+	pthread_mutex_unlock(&frame_lock);
+}
+
+int reclaim_pop_map(addr_t fpn, struct pcb_t **owner, addr_t *pgn)
+{
+	struct frame_map *m;
+
+	if (fpn >= (addr_t)nr_frames)
+		return -1;
+
+	pthread_mutex_lock(&frame_lock);
+	m = frames[fpn].maps;
+	if (m == NULL || frames[fpn].owner != NULL) {
+		pthread_mutex_unlock(&frame_lock);
+		return -1;
+	}
+	frames[fpn].maps = m->next;
+	pthread_mutex_unlock(&frame_lock);
+
+	*owner = m->owner;
+	*pgn = m->pgn;
+	free(m);
+	return 0;
+}
+
+void reclaim_report(void)
+{
+	pthread_mutex_lock(&frame_lock);
+	log_printf("Reclaim: policy %s, %lu victims, %lu pages scanned, %lu passed over "
+		   "(%lu parked for a running process)\n",
+		   policies[reclaim_policy].name, nr_selected, nr_scanned,
+		   nr_rotated, nr_parked);
+	pthread_mutex_unlock(&frame_lock);
+}
@@ -0,0 +1,173 @@
+/*
+ * Swap devices
+ *
+ * The device table is kept sorted by priority, highest first, so a slot
+ * search walks groups of equal priority in order. Each group remembers
+ * which of its devices comes next, an allocation starts there and the
+ * cursor moves past the device that served it. A slot counts the swap
+ * entries naming it, fork copies them, and is free again at zero.
+ */
+
+#include "swapdev.h"
+#include "mm.h"
+#include "log.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+struct swap_dev {
+	struct memphy_struct *mp;
+	int type;		/* device number in the swap type field */
+	int prio;
+	int next;		/* first device of a group: offset served next */
+	unsigned short *refs;	/* swap entries per slot */
+	unsigned long used;	/* slots taken */
+	unsigned long reads;	/* pages */
+	unsigned long writes;
+};
+
+static pthread_mutex_t swapdev_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct swap_dev devs[PAGING_MAX_MMSWP];
+static struct swap_dev *by_type[PAGING_MAX_MMSWP];
+static int nr_devs;
+
+void swapdev_init(struct memphy_struct *mswp, const int *prio, int n)
+{
+	struct swap_dev d;
+	int i, j;
+
+	pthread_mutex_lock(&swapdev_lock);
+	for (i = 0; i < nr_devs; i++)
+		free(devs[i].refs);
+	nr_devs = 0;
+	for (i = 0; i < PAGING_MAX_MMSWP; i++)
+		by_type[i] = NULL;
+
+	for (i = 0; i < n && i < PAGING_MAX_MMSWP; i++) {
+		if (mswp[i].maxsz < PAGING_PAGESZ)
+			continue;
+		d.mp = &mswp[i];
+		d.type = i;
+		d.prio = prio ? prio[i] : 0;
+		d.next = 0;
+		d.refs = calloc(mswp[i].maxsz / PAGING_PAGESZ, sizeof(unsigned short));
+		d.used = d.reads = d.writes = 0;
+
+		/* Insertion keeps equal priorities in device order */
+		for (j = nr_devs; j > 0 && devs[j - 1].prio < d.prio; j--)
+			devs[j] = devs[j - 1];
+		devs[j] = d;
+		nr_devs++;
+	}
+	for (i = 0; i < nr_devs; i++)
+		by_type[devs[i].type] = &devs[i];
+	pthread_mutex_unlock(&swapdev_lock);
+}
+
+int swapdev_get_slot(int *type, addr_t *off)
+{
+	struct swap_dev *d;
+	int g, end, n, k;
+
+	pthread_mutex_lock(&swapdev_lock);
+	for (g = 0; g < nr_devs; g = end) {
+		for (end = g + 1; end < nr_devs && devs[end].prio == devs[g].prio; end++)
+			;
+		n = end - g;
+		for (k = 0; k < n; k++) {
+			d = &devs[g + (devs[g].next + k) % n];
+			if (MEMPHY_get_freefp(d->mp, off) != 0)
+				continue;
+			devs[g].next = (devs[g].next + k + 1) % n;
+			d->refs[*off] = 1;
+			d->used++;
+			*type = d->type;
+			pthread_mutex_unlock(&swapdev_lock);
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&swapdev_lock);
+	return -1;
+}
+
+void swapdev_put_slot(int type, addr_t off)
+{
+	struct swap_dev *d = (type < PAGING_MAX_MMSWP) ? by_type[type] : NULL;
+
+	if (d == NULL)
+		return;
+	pthread_mutex_lock(&swapdev_lock);
+	if (d->refs[off] > 1) {
+		d->refs[off]--;
+		pthread_mutex_unlock(&swapdev_lock);
+		return;
+	}
+	d->refs[off] = 0;
+	d->used--;
+	pthread_mutex_unlock(&swapdev_lock);
+	MEMPHY_put_freefp(d->mp, off);
+}
+
+void swapdev_dup_slot(int type, addr_t off)
+{
+	struct swap_dev *d = (type < PAGING_MAX_MMSWP) ? by_type[type] : NULL;
+
+	if (d == NULL)
+		return;
+	pthread_mutex_lock(&swapdev_lock);
+	d->refs[off]++;
+	pthread_mutex_unlock(&swapdev_lock);
+}
+
+int swapdev_write(int type, addr_t off, struct memphy_struct *mram, addr_t fpn)
+{
+	struct swap_dev *d = (type < PAGING_MAX_MMSWP) ? by_type[type] : NULL;
+
+	if (d == NULL || MEMPHY_copy_page(mram, fpn, d->mp, off) != 0)
+		return -1;
+	pthread_mutex_lock(&swapdev_lock);
+	d->writes++;
+	pthread_mutex_unlock(&swapdev_lock);
+	return 0;
+}
+
+int swapdev_read(int type, addr_t off, struct memphy_struct *mram, addr_t fpn)
+{
+	struct swap_dev *d = (type < PAGING_MAX_MMSWP) ? by_type[type] : NULL;
+
+	if (d == NULL || MEMPHY_copy_page(d->mp, off, mram, fpn) != 0)
+		return -1;
+	pthread_mutex_lock(&swapdev_lock);
+	d->reads++;
+	pthread_mutex_unlock(&swapdev_lock);
+	return 0;
+}
+
+int swapdev_io(int type, unsigned long *reads, unsigned long *writes)
+{
+	struct swap_dev *d = (type < PAGING_MAX_MMSWP) ? by_type[type] : NULL;
+
+	if (d == NULL)
+		return -1;
+	pthread_mutex_lock(&swapdev_lock);
+	*reads = d->reads;
+	*writes = d->writes;
+	pthread_mutex_unlock(&swapdev_lock);
+	return 0;
+}
+
+void swapdev_report(void)
+{
+	struct swap_dev *d;
+	int i;
+
+	pthread_mutex_lock(&swapdev_lock);
+	for (i = 0; i < PAGING_MAX_MMSWP; i++) {
+		d = by_type[i];
+		if (d == NULL)
+			continue;
+		log_printf("Swap %d: prio %d, %lu of %d slots used, %lu pages read, %lu written\n",
+			   d->type, d->prio, d->used, d->mp->maxsz / PAGING_PAGESZ,
+			   d->reads, d->writes);
+	}
+	pthread_mutex_unlock(&swapdev_lock);
+}
@@ -16,6 +16,8 @@
 
 #include "string.h"
 #include "mm.h"
+#include "log.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -42,6 +44,7 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid)
 
 int __mm_swap_page(struct pcb_t *caller, addr_t vicfpn , addr_t swpfpn)
 {
+    TRACE(TRACE_SWAPOUT, caller->pid, vicfpn, swpfpn);
     return __swap_cp_page(caller->krnl->mram, vicfpn, caller->krnl->active_mswp, swpfpn);
 }
 
@@ -124,7 +127,7 @@ int inc_vma_limit(struct pcb_t *caller, int vmaid, addr_t inc_sz)
          
     /* Map RAM vật lý cho vùng mới mở rộng */
     if (vm_map_ram(caller, old_limit, new_limit, old_limit, incnumpage, &ret_rg) < 0) {
-        printf("[ERROR] inc_vma_limit: vm_map_ram failed\n");
+        log_printf("[ERROR] inc_vma_limit: vm_map_ram failed\n");
         return -1;
     }
 
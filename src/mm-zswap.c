@@ -0,0 +1,292 @@
+/*
+ * Compressed swap pool
+ *
+ * Entries are kept in a table indexed by handle, unused slots are
+ * chained on a free list and an entry lives as long as a swap entry
+ * holds its handle. BYTE is a plain char, the codec works on
+ * unsigned bytes. Pages compress with a small LZ77 codec over
+ * the page itself: a control byte below 0x80 announces that many plus
+ * one literal bytes, one at 0x80 or above a match of (c & 0x7f) + 3
+ * bytes at the little endian 16-bit distance that follows. Matches are
+ * found through a hash of the next three bytes, one candidate each.
+ */
+
+#include "zswap.h"
+#include "mm.h"
+#include "log.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZC_HASH_BITS 12
+#define ZC_MIN_MATCH 3
+#define ZC_MAX_MATCH (0x7f + ZC_MIN_MATCH)
+#define ZC_MAX_LIT 0x80
+
+/* Pages saving less than a quarter go to the swap device */
+#define ZSWAP_MAX_LEN (PAGING_PAGESZ * 3 / 4)
+
+struct zswap_ent {
+	uint8_t *data;		/* compressed page, NULL when same-filled */
+	int len;
+	BYTE fill;
+	int refs;		/* swap entries holding the handle */
+	int next;		/* free list link, -1 terminated */
+};
+
+static pthread_mutex_t zswap_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct zswap_ent *ents;
+static int nr_ents;
+static int free_ent = -1;
+static addr_t pool_max;
+static addr_t pool_used;	/* compressed bytes held */
+static unsigned long nr_held;	/* entries held, compressed or same-filled */
+
+/* Counters of the run, under zswap_lock */
+static unsigned long nr_stored, nr_same, nr_loads;
+static unsigned long nr_reject_full, nr_reject_poor;
+static unsigned long long bytes_in, bytes_out;	/* of compressed stores */
+
+static inline uint32_t zc_hash(const uint8_t *p)
+{
+	uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+
+	return (v * 2654435761u) >> (32 - ZC_HASH_BITS);
+}
+
+/* Emit the literals [src, src + n), 0 on success, -1 past [max] */
+static int zc_literals(const uint8_t *src, int n, uint8_t *out, int *op, int max)
+{
+	int run;
+
+	while (n > 0) {
+		run = (n > ZC_MAX_LIT) ? ZC_MAX_LIT : n;
+		if (*op + 1 + run > max)
+			return -1;
+		out[(*op)++] = run - 1;
+		memcpy(out + *op, src, run);
+		*op += run;
+		src += run;
+		n -= run;
+	}
+	return 0;
+}
+
+/* Compress a page into [out], the length or -1 when it exceeds [max] */
+static int zc_compress(const uint8_t *in, uint8_t *out, int max)
+{
+	uint16_t table[1 << ZC_HASH_BITS];	/* position + 1, 0 is empty */
+	int ip = 0, op = 0, lit = 0, cand, len, off;
+	uint32_t h;
+
+	memset(table, 0, sizeof(table));
+	while (ip + ZC_MIN_MATCH <= PAGING_PAGESZ) {
+		h = zc_hash(in + ip);
+		cand = table[h] - 1;
+		table[h] = ip + 1;
+		if (cand < 0 || memcmp(in + cand, in + ip, ZC_MIN_MATCH) != 0) {
+			ip++;
+			continue;
+		}
+
+		len = ZC_MIN_MATCH;
+		while (ip + len < PAGING_PAGESZ && len < ZC_MAX_MATCH &&
+		       in[cand + len] == in[ip + len])
+			len++;
+
+		if (zc_literals(in + lit, ip - lit, out, &op, max) != 0 ||
+		    op + 3 > max)
+			return -1;
+		off = ip - cand;
+		out[op++] = 0x80 | (len - ZC_MIN_MATCH);
+		out[op++] = off & 0xff;
+		out[op++] = off >> 8;
+		ip += len;
+		lit = ip;
+	}
+
+	if (zc_literals(in + lit, PAGING_PAGESZ - lit, out, &op, max) != 0)
+		return -1;
+	return op;
+}
+
+static void zc_decompress(const uint8_t *in, int len, uint8_t *out)
+{
+	int ip = 0, op = 0, n, off;
+	uint8_t c;
+
+	while (ip < len) {
+		c = in[ip++];
+		if (c < 0x80) {
+			n = c + 1;
+			memcpy(out + op, in + ip, n);
+			ip += n;
+			op += n;
+			continue;
+		}
+		n = (c & 0x7f) + ZC_MIN_MATCH;
+		off = in[ip] | (in[ip + 1] << 8);
+		ip += 2;
+		/* Bytewise, a match may overlap what it produces */
+		for (; n > 0; n--, op++)
+			out[op] = out[op - off];
+	}
+}
+
+/* An unused entry, growing the table when none is left */
+static int ent_alloc(void)
+{
+	int i, idx, n;
+
+	if (free_ent < 0) {
+		n = nr_ents ? 2 * nr_ents : 64;
+		ents = realloc(ents, n * sizeof(struct zswap_ent));
+		for (i = n - 1; i >= nr_ents; i--) {
+			ents[i].data = NULL;
+			ents[i].next = free_ent;
+			free_ent = i;
+		}
+		nr_ents = n;
+	}
+
+	idx = free_ent;
+	free_ent = ents[idx].next;
+	return idx;
+}
+
+static void ent_free(int idx)
+{
+	if (ents[idx].data != NULL) {
+		pool_used -= ents[idx].len;
+		free(ents[idx].data);
+		ents[idx].data = NULL;
+	}
+	ents[idx].next = free_ent;
+	free_ent = idx;
+	nr_held--;
+}
+
+void zswap_init(addr_t poolsz)
+{
+	pthread_mutex_lock(&zswap_lock);
+	pool_max = poolsz;
+	nr_stored = nr_same = nr_loads = 0;
+	nr_reject_full = nr_reject_poor = 0;
+	bytes_in = bytes_out = 0;
+	pthread_mutex_unlock(&zswap_lock);
+}
+
+int zswap_store(const BYTE *page, addr_t *handle)
+{
+	uint8_t buf[PAGING_PAGESZ];
+	int i, idx, len;
+
+	if (pool_max == 0)
+		return -1;
+
+	for (i = 1; i < PAGING_PAGESZ && page[i] == page[0]; i++)
+		;
+	if (i == PAGING_PAGESZ) {
+		pthread_mutex_lock(&zswap_lock);
+		idx = ent_alloc();
+		ents[idx].len = 0;
+		ents[idx].fill = page[0];
+		ents[idx].refs = 1;
+		nr_held++;
+		nr_stored++;
+		nr_same++;
+		pthread_mutex_unlock(&zswap_lock);
+		*handle = idx;
+		return 0;
+	}
+
+	len = zc_compress((const uint8_t *)page, buf, ZSWAP_MAX_LEN);
+
+	pthread_mutex_lock(&zswap_lock);
+	if (len < 0) {
+		nr_reject_poor++;
+		pthread_mutex_unlock(&zswap_lock);
+		return -1;
+	}
+	if (pool_used + len > pool_max) {
+		nr_reject_full++;
+		pthread_mutex_unlock(&zswap_lock);
+		return -1;
+	}
+
+	idx = ent_alloc();
+	ents[idx].data = malloc(len);
+	memcpy(ents[idx].data, buf, len);
+	ents[idx].len = len;
+	ents[idx].refs = 1;
+	pool_used += len;
+	nr_held++;
+	nr_stored++;
+	bytes_in += PAGING_PAGESZ;
+	bytes_out += len;
+	pthread_mutex_unlock(&zswap_lock);
+
+	*handle = idx;
+	return 0;
+}
+
+int zswap_load(addr_t handle, BYTE *page)
+{
+	struct zswap_ent *e;
+
+	pthread_mutex_lock(&zswap_lock);
+	if (handle >= (addr_t)nr_ents) {
+		pthread_mutex_unlock(&zswap_lock);
+		return -1;
+	}
+
+	e = &ents[handle];
+	if (e->data == NULL)
+		memset(page, e->fill, PAGING_PAGESZ);
+	else
+		zc_decompress(e->data, e->len, (uint8_t *)page);
+	nr_loads++;
+	pthread_mutex_unlock(&zswap_lock);
+	return 0;
+}
+
+void zswap_invalidate(addr_t handle)
+{
+	pthread_mutex_lock(&zswap_lock);
+	if (handle < (addr_t)nr_ents && --ents[handle].refs == 0)
+		ent_free(handle);
+	pthread_mutex_unlock(&zswap_lock);
+}
+
+void zswap_dup(addr_t handle)
+{
+	pthread_mutex_lock(&zswap_lock);
+	if (handle < (addr_t)nr_ents)
+		ents[handle].refs++;
+	pthread_mutex_unlock(&zswap_lock);
+}
+
+void zswap_counters(unsigned long *stored, unsigned long *loads, double *ratio)
+{
+	pthread_mutex_lock(&zswap_lock);
+	*stored = nr_stored;
+	*loads = nr_loads;
+	*ratio = bytes_out ? (double)bytes_in / bytes_out : 0.0;
+	pthread_mutex_unlock(&zswap_lock);
+}
+
+void zswap_report(void)
+{
+	pthread_mutex_lock(&zswap_lock);
+	log_printf("Zswap: %lu pages stored (%lu same-filled), %lu rejected "
+		   "(%lu pool full, %lu incompressible), ratio %.2f\n",
+		   nr_stored, nr_same, nr_reject_full + nr_reject_poor,
+		   nr_reject_full, nr_reject_poor,
+		   bytes_out ? (double)bytes_in / bytes_out : 0.0);
+	log_printf("\tswap device writes avoided %lu, reads avoided %lu, "
+		   "pool %lu of %lu bytes in %lu entries\n",
+		   nr_stored, nr_loads, (unsigned long)pool_used,
+		   (unsigned long)pool_max, nr_held);
+	pthread_mutex_unlock(&zswap_lock);
+}
@@ -26,7 +26,7 @@
 /*
  * init_pte - Initialize PTE entry
  */
-int init_pte(addr_t *pte,
+int init_pte(pte_t *pte,
              int pre,    // present
              addr_t fpn,    // FPN
              int drt,    // dirty
@@ -99,7 +99,7 @@ int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_
 int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
 {
   struct krnl_t *krnl = caller->krnl;
-  addr_t *pte = &krnl->mm->pgd[pgn];
+  pte_t *pte = &krnl->mm->pgd[pgn];
 	
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
@@ -118,7 +118,7 @@ int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
 int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
 {
   struct krnl_t *krnl = caller->krnl;
-  addr_t *pte = &krnl->mm->pgd[pgn];
+  pte_t *pte = &krnl->mm->pgd[pgn];
 
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
@@ -134,7 +134,7 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
+pte_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
 {
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
   return 0;
@@ -145,7 +145,7 @@ uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, pte_t pte_val)
 {
 	struct krnl_t *krnl = caller->krnl;
 	krnl->mm->pgd[pgn]=pte_val;
@@ -229,6 +229,12 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   return 0;
 }
 
+int free_mm(struct mm_struct *mm, struct pcb_t *caller)
+{
+  printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
+  return 0;
+}
+
 struct vm_rg_struct *init_vm_rg(addr_t rg_start, addr_t rg_end)
 {
   printf("[ERROR] %s: This feature 32 bit mode is deprecated\n", __func__);
@@ -14,21 +14,23 @@
  */
 
 #include "mm64.h"
+#include "log.h"
+#include "tlb.h"
+#include "reclaim.h"
+#include "zswap.h"
+#include "swapdev.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if defined(MM64)
 
 /*
  * init_pte - Initialize PTE entry
  */
-static addr_t *ensure_pte_mapping(struct pcb_t *caller, 
-                                  addr_t pgd_idx, addr_t p4d_idx, addr_t pud_idx, 
-                                  addr_t pmd_idx, addr_t pt_idx);
-
-int init_pte(addr_t *pte,
+int init_pte(pte_t *pte,
              int pre,    // present
              addr_t fpn,    // FPN
              int drt,    // dirty
@@ -108,88 +110,319 @@ int get_pd_from_pagenum(addr_t pgn, addr_t* pgd, addr_t* p4d, addr_t* pud, addr_
 
 
 /*
- * pte_set_swap - Set PTE entry for swapped page
- * @pte    : target page table entry (PTE)
- * @swptyp : swap type
- * @swpoff : swap offset
+ * dir_next - Follow a directory entry to the table it points to
+ * @alloc : give the entry a zeroed table when it has none
  */
-int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
+static pte_t *dir_next(struct krnl_t *krnl, pte_t *entry, int alloc)
 {
-  struct krnl_t *krnl = caller->krnl;
+  addr_t fpn;
 
-  addr_t *pte;
-  addr_t pgd;
-  addr_t p4d;
-  addr_t pud;
-  addr_t pmd;
-  addr_t pt;
-	
-#ifdef MM64	
-  /* Get value from the system */
-  get_pd_from_pagenum(pgn, &pgd, &p4d, &pud, &pmd, &pt);
-  if (get_pd_from_pagenum(pgn, &pgd, &p4d, &pud, &pmd, &pt) != 0) {
-      return -1; /* Invalid page number */
+  if (!PAGING_PTE_PRESENT(*entry)) {
+    if (!alloc)
+      return NULL;
+    if (MEMPHY_get_freefp(krnl->mram, &fpn) != 0)
+      return NULL; /* No free frames */
+
+    /* Not init_pte(), a directory may well sit in frame 0 */
+    *entry = 0;
+    SETBIT(*entry, PAGING_PTE_PRESENT_MASK);
+    SETVAL(*entry, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    krnl->mm->pgtbl_frames++;
+
+    MEMPHY_zero_page(krnl->mram, fpn);
+    return (pte_t *)(krnl->mram->storage + (fpn * PAGING_PAGESZ));
   }
-  
-  addr_t *pgd_entry = &krnl->mm->pgd[pgd];
-  if(!PAGING_PTE_PRESENT(*pgd_entry)){
-     addr_t p4d_fpn;
-     if (MEMPHY_get_freefp(krnl->mram, &p4d_fpn) != 0) {
-      return -1; /* No free frames */
+
+  fpn = PAGING_PTE_FPN(*entry);
+  if ((fpn + 1) * PAGING_PAGESZ > krnl->mram->maxsz)
+    return NULL;
+  return (pte_t *)(krnl->mram->storage + (fpn * PAGING_PAGESZ));
+}
+
+/*
+ * pgtbl_grow - Unfold one level above the root table
+ *
+ * The root contents move to a fresh RAM frame and the root becomes the
+ * level above, its first entry pointing at that frame. An empty root
+ * just changes level. Walks cached in mm->pwc may point into the old
+ * root and are dropped.
+ */
+static int pgtbl_grow(struct krnl_t *krnl)
+{
+  struct mm_struct *mm = krnl->mm;
+  pte_t entry = 0;
+  pte_t *dir;
+  int i;
+
+  if (mm->top == 0)
+    return -1;
+
+  for (i = 0; i < PAGING64_PT_ENTRIES; i++)
+    if (mm->pgd[i] != 0)
+      break;
+  if (i < PAGING64_PT_ENTRIES) {
+    dir = dir_next(krnl, &entry, 1);
+    if (dir == NULL)
+      return -1;
+
+    memcpy(dir, mm->pgd, PAGING64_PT_ENTRIES * sizeof(pte_t));
+    memset(mm->pgd, 0, PAGING64_PT_ENTRIES * sizeof(pte_t));
+    mm->pgd[0] = entry;
+  }
+  mm->top--;
+
+  for (i = 0; i < MM64_PWC_ENTRIES; i++)
+    mm->pwc[i].pt = NULL;
+  return 0;
+}
+
+/* pgtbl_covers - the root reaches [idx], all indexes above it are zero */
+static int pgtbl_covers(struct mm_struct *mm, addr_t *idx)
+{
+  int lvl;
+
+  for (lvl = 0; lvl < mm->top; lvl++)
+    if (idx[lvl] != 0)
+      return 0;
+  return 1;
+}
+
+/*
+ * pmd_walk - Find the PMD entry covering a page
+ * @alloc : allocate the missing directory levels on the way down,
+ *          unfolding the root first when it does not reach the page
+ */
+static pte_t *pmd_walk(struct krnl_t *krnl, addr_t pgn, int alloc)
+{
+  struct mm_struct *mm = krnl->mm;
+  addr_t idx[5];
+  pte_t *dir;
+  int lvl;
+
+  if (get_pd_from_pagenum(pgn, &idx[0], &idx[1], &idx[2], &idx[3], &idx[4]) != 0)
+    return NULL;
+
+  /* A PT root has no PMD entry to return */
+  while (mm->top > 3 || !pgtbl_covers(mm, idx)) {
+    if (!alloc || pgtbl_grow(krnl) != 0)
+      return NULL;
+  }
+
+  /* The root lives in host memory, the lower levels in RAM frames */
+  dir = mm->pgd;
+  for (lvl = mm->top; lvl < 3; lvl++) {
+    dir = dir_next(krnl, &dir[idx[lvl]], alloc);
+    if (dir == NULL)
+      return NULL;
+  }
+
+  return &dir[idx[3]];
+}
+
+/*
+ * pmd_split - Turn a huge PMD mapping into a PT of 512 small pages
+ */
+static int pmd_split(struct krnl_t *krnl, pte_t *pmd)
+{
+  pte_t huge = *pmd;
+  addr_t base = PAGING_PTE_FPN(huge);
+  pte_t *pt;
+  int i;
+
+  *pmd = 0;
+  pt = dir_next(krnl, pmd, 1);
+  if (pt == NULL) {
+    *pmd = huge;
+    return -1;
+  }
+
+  for (i = 0; i < PAGING64_PT_ENTRIES; i++) {
+    pt[i] = huge & ~(PAGING_PTE_HUGE_MASK | PAGING_PTE_FPN_MASK);
+    SETVAL(pt[i], (base + i), PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  }
+
+  return 0;
+}
+
+/*
+ * pte_walk - Find the PTE of a page in the 5 level table
+ * @krnl  : kernel holding the mm and the RAM the tables live in
+ * @pgn   : page number
+ * @alloc : allocate the missing directory levels on the way down,
+ *          a huge mapping on the way is split into small pages
+ * @huge  : set when the returned entry is a huge PMD entry
+ *
+ * The PT pages of the last walked 2MB regions are remembered in mm->pwc,
+ * a walk landing in one of them reads the PT page directly instead of
+ * going through PGD, P4D, PUD and PMD again.
+ */
+static pte_t *pte_walk(struct krnl_t *krnl, addr_t pgn, int alloc, int *huge)
+{
+  struct mm_struct *mm = krnl->mm;
+  struct pwc_entry *pwc;
+  pte_t *pmd, *pt;
+
+  *huge = 0;
+  pwc = &mm->pwc[(pgn >> 9) & (MM64_PWC_ENTRIES - 1)];
+  if (pwc->pt != NULL && pwc->tag == (pgn >> 9)) {
+    if (!pwc->huge)
+      return &pwc->pt[pgn & (PAGING64_PT_ENTRIES - 1)];
+    if (!alloc) {
+      *huge = 1;
+      return pwc->pt;
     }
-     init_pte(pgd_entry, 1, p4d_fpn, 0, 0, 0, 0);
   }
-  
-  addr_t p4d_fpn = PAGING_PTE_FPN(*pgd_entry);
-  addr_t *p4d_table = (addr_t*)(krnl->mram->storage + (p4d_fpn * PAGING_PAGESZ));
-  addr_t *p4d_entry = &p4d_table[p4d];
-
-  if (!PAGING_PTE_PRESENT(*p4d_entry)) {
-      addr_t pud_fpn;
-      if (MEMPHY_get_freefp(krnl->mram, &pud_fpn) != 0) {
-        return -1;
+
+  if (mm->top == 4 && (pgn >> 9) == 0) {
+    /* The root is the only PT */
+    pt = mm->pgd;
+  } else {
+    pmd = pmd_walk(krnl, pgn, alloc);
+    if (pmd == NULL)
+      return NULL;
+
+    if (PAGING_PTE_PRESENT(*pmd) && (*pmd & PAGING_PTE_HUGE_MASK)) {
+      if (!alloc) {
+        pwc->tag = pgn >> 9;
+        pwc->pt = pmd;
+        pwc->huge = 1;
+        *huge = 1;
+        return pmd;
       }
-        init_pte(p4d_entry, 1, pud_fpn, 0, 0, 0, 0);
-    }
-    
-  addr_t pud_fpn = PAGING_PTE_FPN(*p4d_entry);
-  addr_t *pud_table = (addr_t*)(krnl->mram->storage + (pud_fpn * PAGING_PAGESZ));
-  addr_t *pud_entry = &pud_table[pud];
-  
-  if (!PAGING_PTE_PRESENT(*pud_entry)) {
-      addr_t pmd_fpn;
-      if (MEMPHY_get_freefp(krnl->mram, &pmd_fpn) != 0) {
-        return -1;
-       }
-        init_pte(pud_entry, 1, pmd_fpn, 0, 0, 0, 0);
-    }
-    
-  addr_t pmd_fpn = PAGING_PTE_FPN(*pud_entry);
-  addr_t *pmd_table = (addr_t*)(krnl->mram->storage + (pmd_fpn * PAGING_PAGESZ));
-  addr_t *pmd_entry = &pmd_table[pmd];
-    
-  if (!PAGING_PTE_PRESENT(*pmd_entry)) {
-     addr_t pt_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &pt_fpn) != 0) {
-     return -1;
+      pwc->pt = NULL;
+      if (pmd_split(krnl, pmd) != 0)
+        return NULL;
     }
-        init_pte(pmd_entry, 1, pt_fpn, 0, 0, 0, 0);
+
+    pt = dir_next(krnl, pmd, alloc);
+    if (pt == NULL)
+      return NULL;
+  }
+
+  pwc->tag = pgn >> 9;
+  pwc->pt = pt;
+  pwc->huge = 0;
+
+  return &pt[pgn & (PAGING64_PT_ENTRIES - 1)];
+}
+
+/*
+ * pmd_map_huge - Back the whole 2MB region of a faulting page at once
+ * @caller : caller
+ * @pgn    : faulting page number
+ * @fpn    : frame now backing [pgn]
+ *
+ * Only done when the region lies within the heap below sbrk, its PMD
+ * has no PT page yet and the RAM still has 512 contiguous free frames.
+ * Otherwise the caller falls back to a 4KB page.
+ */
+int pmd_map_huge(struct pcb_t *caller, addr_t pgn, addr_t *fpn)
+{
+  struct krnl_t *krnl = caller->krnl;
+  struct vm_area_struct *vma = get_vma_by_num(krnl->mm, 0);
+  addr_t base = pgn & ~(addr_t)(PAGING64_PT_ENTRIES - 1);
+  addr_t start = base * PAGING_PAGESZ;
+  addr_t hfpn;
+  pte_t *pmd;
+  int i;
+
+  if (vma == NULL || start < vma->vm_start ||
+      start + PAGING64_HUGE_PAGESZ > vma->sbrk)
+    return -1;
+
+  pmd = pmd_walk(krnl, pgn, 1);
+  if (pmd == NULL || PAGING_PTE_PRESENT(*pmd))
+    return -1;
+
+  if (MEMPHY_get_freefp_range(krnl->mram, PAGING64_PT_ENTRIES, &hfpn) != 0)
+    return -1;
+
+  *pmd = 0;
+  SETBIT(*pmd, PAGING_PTE_PRESENT_MASK);
+  SETBIT(*pmd, PAGING_PTE_HUGE_MASK);
+  SETVAL(*pmd, hfpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+  for (i = 0; i < PAGING64_PT_ENTRIES; i++)
+    MEMPHY_zero_page(krnl->mram, hfpn + i);
+
+  *fpn = hfpn + (pgn - base);
+  return 0;
+}
+
+/*
+ * pte_map_range - Map a run of pages onto a list of frames
+ * @caller : caller
+ * @pgn    : first page number
+ * @pgnum  : number of pages
+ * @frames : frames backing [pgn] onwards, one per page
+ *
+ * The table is walked once per PT page, the contiguous PTEs inside it
+ * are then filled in place. Returns the number of pages mapped, short
+ * when the frames run out or a table page cannot be allocated.
+ */
+int pte_map_range(struct pcb_t *caller, addr_t pgn, int pgnum,
+                  struct framephy_struct *frames)
+{
+  struct krnl_t *krnl = caller->krnl;
+  struct framephy_struct *fpit = frames;
+  pte_t *pte;
+  addr_t idx;
+  int huge, n = 0;
+
+  while (n < pgnum && fpit != NULL) {
+    pte = pte_walk(krnl, pgn + n, 1, &huge);
+    if (pte == NULL)
+      break;
+
+    for (idx = (pgn + n) & (PAGING64_PT_ENTRIES - 1);
+         idx < PAGING64_PT_ENTRIES && n < pgnum && fpit != NULL;
+         idx++, n++, pte++, fpit = fpit->fp_next) {
+#ifdef MM_TLB
+      pte_t old = *pte;
+#endif
+      *pte = 0;
+      SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
+      SETVAL(*pte, fpit->fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+#ifdef MM_TLB
+      /* Only a page that was mapped before can be cached */
+      if (PAGING_PTE_PRESENT(old))
+        tlb_shootdown(krnl->mm->asid, pgn + n);
+#endif
     }
-    
-    /* Get PT table from PMD entry */
-  addr_t pt_fpn = PAGING_PTE_FPN(*pmd_entry);
-  addr_t *pt_table = (addr_t*)(krnl->mram->storage + (pt_fpn * PAGING_PAGESZ));
-  pte = &pt_table[pt];
+  }
+
+  return n;
+}
+
+/*
+ * pte_set_swap - Set PTE entry for swapped page
+ * @pte    : target page table entry (PTE)
+ * @swptyp : swap type
+ * @swpoff : swap offset
+ */
+int pte_set_swap(struct pcb_t *caller, addr_t pgn, int swptyp, addr_t swpoff)
+{
+  struct krnl_t *krnl = caller->krnl;
+  pte_t *pte;
+  int huge;
+
+#ifdef MM64
+  pte = pte_walk(krnl, pgn, 1, &huge);
+  if (pte == NULL)
+    return -1;
 #else
   pte = &krnl->mm->pgd[pgn];
 #endif
-	
+
+  *pte = 0;
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
   SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
   SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
 
+#ifdef MM_TLB
+  tlb_shootdown(krnl->mm->asid, pgn);
+#endif
   return 0;
 }
 
@@ -205,16 +438,9 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
     return -1;
   }
 
-#ifdef MM64	
-  addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-  
-  // Parse page number to multi-level indices
-  if (get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx) != 0) {
-    return -1;
-  }
-
-  // Ensure all page table levels are allocated and get the final PTE
-  addr_t *pte = ensure_pte_mapping(caller, pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx);
+#ifdef MM64
+  int huge;
+  pte_t *pte = pte_walk(krnl, pgn, 1, &huge);
   if (pte == NULL) {
     return -1;
   }
@@ -224,7 +450,10 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
   SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
-  
+
+#ifdef MM_TLB
+  tlb_shootdown(krnl->mm->asid, pgn);
+#endif
   return 0;
 #else
   // 32-bit implementation
@@ -241,164 +470,75 @@ int pte_set_fpn(struct pcb_t *caller, addr_t pgn, addr_t fpn)
 #endif
 }
 
-/* Ensure all page table levels are allocated and return final PTE */
-static addr_t *ensure_pte_mapping(struct pcb_t *caller, 
-                                  addr_t pgd_idx, addr_t p4d_idx, addr_t pud_idx, 
-                                  addr_t pmd_idx, addr_t pt_idx)
+/*
+ * pte_set_flags - Record an access in the status bits of a present page
+ * @caller : caller
+ * @pgn    : page number
+ * @bits   : PAGING_PTE_ACCESSED_MASK and/or PAGING_PTE_DIRTY_MASK
+ *
+ * Pages inside a huge mapping share the bits of their PMD entry. The
+ * translation is unchanged, so cached TLB entries stay valid.
+ */
+int pte_set_flags(struct pcb_t *caller, addr_t pgn, pte_t bits)
 {
-  struct krnl_t *krnl = caller->krnl;
-  struct mm_struct *mm = krnl->mm;
-  
-  // PGD level - this is in mm->pgd array (virtual memory of kernel)
-  if (!PAGING_PTE_PRESENT(mm->pgd[pgd_idx])) {
-    addr_t p4d_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &p4d_fpn) != 0) {
-      return NULL;
-    }
-    init_pte(&mm->pgd[pgd_idx], 1, p4d_fpn, 0, 0, 0, 0);
-    
-    // Initialize the P4D table to zeros
-    addr_t *p4d_table = (addr_t*)(krnl->mram->storage + (p4d_fpn * PAGING_PAGESZ));
-    for (int i = 0; i < PAGING64_P4D_ENTRIES; i++) {
-      p4d_table[i] = 0;
-    }
-  }
-  
-  addr_t p4d_fpn = PAGING_PTE_FPN(mm->pgd[pgd_idx]);
-  addr_t *p4d_table = (addr_t*)(krnl->mram->storage + (p4d_fpn * PAGING_PAGESZ));
-  
-  // P4D level  
-  if (!PAGING_PTE_PRESENT(p4d_table[p4d_idx])) {
-    addr_t pud_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &pud_fpn) != 0) {
-      return NULL;
-    }
-    init_pte(&p4d_table[p4d_idx], 1, pud_fpn, 0, 0, 0, 0);
-    
-    // Initialize the PUD table to zeros
-    addr_t *pud_table = (addr_t*)(krnl->mram->storage + (pud_fpn * PAGING_PAGESZ));
-    for (int i = 0; i < PAGING64_PUD_ENTRIES; i++) {
-      pud_table[i] = 0;
-    }
-  }
-  
-  addr_t pud_fpn = PAGING_PTE_FPN(p4d_table[p4d_idx]);
-  addr_t *pud_table = (addr_t*)(krnl->mram->storage + (pud_fpn * PAGING_PAGESZ));
-  
-  // PUD level
-  if (!PAGING_PTE_PRESENT(pud_table[pud_idx])) {
-    addr_t pmd_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &pmd_fpn) != 0) {
-      return NULL;
-    }
-    init_pte(&pud_table[pud_idx], 1, pmd_fpn, 0, 0, 0, 0);
-    
-    // Initialize the PMD table to zeros
-    addr_t *pmd_table = (addr_t*)(krnl->mram->storage + (pmd_fpn * PAGING_PAGESZ));
-    for (int i = 0; i < PAGING64_PMD_ENTRIES; i++) {
-      pmd_table[i] = 0;
-    }
-  }
-  
-  addr_t pmd_fpn = PAGING_PTE_FPN(pud_table[pud_idx]);
-  addr_t *pmd_table = (addr_t*)(krnl->mram->storage + (pmd_fpn * PAGING_PAGESZ));
-  
-  // PMD level
-  if (!PAGING_PTE_PRESENT(pmd_table[pmd_idx])) {
-    addr_t pt_fpn;
-    if (MEMPHY_get_freefp(krnl->mram, &pt_fpn) != 0) {
-      return NULL;
-    }
-    init_pte(&pmd_table[pmd_idx], 1, pt_fpn, 0, 0, 0, 0);
-    
-    // Initialize the PT table to zeros
-    addr_t *pt_table = (addr_t*)(krnl->mram->storage + (pt_fpn * PAGING_PAGESZ));
-    for (int i = 0; i < PAGING64_PT_ENTRIES; i++) {
-      pt_table[i] = 0;
-    }
-  }
-  
-  addr_t pt_fpn = PAGING_PTE_FPN(pmd_table[pmd_idx]);
-  addr_t *pt_table = (addr_t*)(krnl->mram->storage + (pt_fpn * PAGING_PAGESZ));
-  
-  return &pt_table[pt_idx];
+  int huge;
+  pte_t *pte = pte_walk(caller->krnl, pgn, 0, &huge);
+
+  if (pte == NULL || !PAGING_PTE_PRESENT(*pte) || PAGING_PTE_SWAPPED(*pte))
+    return -1;
+  *pte |= bits;
+  return 0;
 }
 
+/*
+ * pte_clear_flags - Clear status bits of a present page
+ * @caller : caller
+ * @pgn    : page number
+ * @bits   : PAGING_PTE_ACCESSED_MASK and/or PAGING_PTE_DIRTY_MASK
+ *
+ * The page is shot down, so the next access walks the table and sets
+ * the bits again.
+ */
+int pte_clear_flags(struct pcb_t *caller, addr_t pgn, pte_t bits)
+{
+  int huge;
+  pte_t *pte = pte_walk(caller->krnl, pgn, 0, &huge);
+
+  if (pte == NULL || !PAGING_PTE_PRESENT(*pte) || PAGING_PTE_SWAPPED(*pte))
+    return -1;
+  *pte &= ~bits;
+#ifdef MM_TLB
+  tlb_shootdown(caller->krnl->mm->asid, pgn);
+#endif
+  return 0;
+}
 
 /* Get PTE page table entry
  * @caller : caller
  * @pgn    : page number
  * @ret    : page table entry
  **/
-/* Get PTE page table entry */
-uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
+pte_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
 {
     if (caller == NULL || caller->krnl == NULL || caller->krnl->mm == NULL) {
         return 0;
     }
 
 #ifdef MM64
-    addr_t pgd_idx, p4d_idx, pud_idx, pmd_idx, pt_idx;
-    
-    if (get_pd_from_pagenum(pgn, &pgd_idx, &p4d_idx, &pud_idx, &pmd_idx, &pt_idx) != 0) {
-        return 0;
-    }
+    int huge;
+    pte_t *pte = pte_walk(caller->krnl, pgn, 0, &huge);
+    pte_t val;
 
-    struct krnl_t *krnl = caller->krnl;
-    struct mm_struct *mm = krnl->mm;
-    
-    // printf("[MM64-Trace] Access PGN: %05lx | Indices: PGD[%lx] -> P4D[%lx] -> PUD[%lx] -> PMD[%lx] -> PT[%lx]\n", 
-    //        (unsigned long)pgn, 
-    //        (unsigned long)pgd_idx, (unsigned long)p4d_idx, 
-    //        (unsigned long)pud_idx, (unsigned long)pmd_idx, 
-    //        (unsigned long)pt_idx);
-    // Traverse multi-level page tables
-    if (!PAGING_PTE_PRESENT(mm->pgd[pgd_idx])) {
-        return 0;
-    }
-    
-    addr_t p4d_fpn = PAGING_PTE_FPN(mm->pgd[pgd_idx]);
-    // 🚨 QUAN TRỌNG: Kiểm tra bounds
-    if (p4d_fpn * PAGING_PAGESZ >= krnl->mram->maxsz) {
-        return 0;
-    }
-    
-    addr_t *p4d_table = (addr_t*)(krnl->mram->storage + (p4d_fpn * PAGING_PAGESZ));
-    
-    if (!PAGING_PTE_PRESENT(p4d_table[p4d_idx])) {
-        return 0;
-    }
-    
-    addr_t pud_fpn = PAGING_PTE_FPN(p4d_table[p4d_idx]);
-    if (pud_fpn * PAGING_PAGESZ >= krnl->mram->maxsz) {
-        return 0;
-    }
-    
-    addr_t *pud_table = (addr_t*)(krnl->mram->storage + (pud_fpn * PAGING_PAGESZ));
-    
-    if (!PAGING_PTE_PRESENT(pud_table[pud_idx])) {
+    if (pte == NULL)
         return 0;
-    }
-    
-    addr_t pmd_fpn = PAGING_PTE_FPN(pud_table[pud_idx]);
-    if (pmd_fpn * PAGING_PAGESZ >= krnl->mram->maxsz) {
-        return 0;
-    }
-    
-    addr_t *pmd_table = (addr_t*)(krnl->mram->storage + (pmd_fpn * PAGING_PAGESZ));
-    
-    if (!PAGING_PTE_PRESENT(pmd_table[pmd_idx])) {
-        return 0;
-    }
-    
-    addr_t pt_fpn = PAGING_PTE_FPN(pmd_table[pmd_idx]);
-    if (pt_fpn * PAGING_PAGESZ >= krnl->mram->maxsz) {
-        return 0;
-    }
-    
-    addr_t *pt_table = (addr_t*)(krnl->mram->storage + (pt_fpn * PAGING_PAGESZ));
-    
-    return pt_table[pt_idx];
+    if (!huge)
+        return *pte;
+
+    /* Present the frame of [pgn] inside the huge mapping as a plain PTE */
+    val = *pte & ~PAGING_PTE_HUGE_MASK;
+    SETVAL(val, (PAGING_PTE_FPN(*pte) + (pgn & (PAGING64_PT_ENTRIES - 1))),
+           PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+    return val;
 #else
     if (pgn >= PAGING_MAX_PGN) {
         return 0;
@@ -414,10 +554,22 @@ uint32_t pte_get_entry(struct pcb_t *caller, addr_t pgn)
  * @pgn    : page number
  * @ret    : page table entry
  **/
-int pte_set_entry(struct pcb_t *caller, addr_t pgn, uint32_t pte_val)
+int pte_set_entry(struct pcb_t *caller, addr_t pgn, pte_t pte_val)
 {
 	struct krnl_t *krnl = caller->krnl;
+#ifdef MM64
+	int huge;
+	pte_t *pte = pte_walk(krnl, pgn, 1, &huge);
+
+	if (pte == NULL)
+		return -1;
+	*pte = pte_val;
+#else
 	krnl->mm->pgd[pgn] = pte_val;
+#endif
+#ifdef MM_TLB
+	tlb_shootdown(krnl->mm->asid, pgn);
+#endif
 	
 	return 0;
 }
@@ -451,68 +603,56 @@ addr_t vmap_page_range(struct pcb_t *caller,           // process call
                     struct framephy_struct *frames, // list of the mapped frames
                     struct vm_rg_struct *ret_rg)    // return mapped region, the real mapped fp
 {                                                   // no guarantee all given pages are mapped
+  addr_t pgn = addr >> PAGING64_ADDR_PT_SHIFT;
   struct framephy_struct *fpit = frames;
-  int pgit = 0;
-  addr_t pgn;
+  int pgit, mapped;
 
   ret_rg->rg_start = addr;
   ret_rg->rg_end = addr + (pgnum * PAGING_PAGESZ);
 
-  for (pgit = 0; pgit < pgnum && fpit != NULL; pgit++) {
-          pgn = PAGING_PGN(addr + (pgit * PAGING_PAGESZ));
-          
-  #ifdef MM64
-          /* For 64-bit: use multi-level page tables */
-          pte_set_fpn(caller, pgn, fpit->fpn);
-  #else
-          pte_set_fpn(caller, pgn, fpit->fpn);
-  #endif
+  mapped = pte_map_range(caller, pgn, pgnum, frames);
 
-          /* Tracking for later page replacement activities (if needed)
-           * Enqueue new usage page */
-          enlist_pgn_node(&caller->krnl->mm->fifo_pgn, pgn);
-          fpit = fpit->fp_next;
-      }
+  /* Tracking for later page replacement activities */
+  for (pgit = 0; pgit < mapped; pgit++, fpit = fpit->fp_next)
+    reclaim_track(caller, fpit->fpn, pgn + pgit);
 
   return 0;
 }
 
+/*
+ * alloc_pages_range - take [req_pgnum] frames of RAM
+ *
+ * The list nodes come in one array, the list is released with a single
+ * free() of its head. Frames are handed out lowest first, so they tend
+ * to be contiguous. Returns 0 when all were taken, else how many were.
+ */
 addr_t alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst)
 {
+    struct framephy_struct *fps;
     addr_t fpn;
-    int pgit;
-    struct framephy_struct *newfp_str = NULL;
-    struct framephy_struct *tail = NULL;
     int allocated = 0;
 
-    for (pgit = 0; pgit < req_pgnum; pgit++)
+    *frm_lst = NULL;
+    if (req_pgnum <= 0)
+        return 0;
+
+    fps = calloc(req_pgnum, sizeof(struct framephy_struct));
+    while (allocated < req_pgnum &&
+           MEMPHY_get_freefp(caller->krnl->mram, &fpn) == 0)
     {
-        if (MEMPHY_get_freefp(caller->krnl->mram, &fpn) == 0)
-        {
-            struct framephy_struct *new_fp = malloc(sizeof(struct framephy_struct));
-            new_fp->fpn = fpn;
-            new_fp->fp_next = NULL;
-            
-            if (newfp_str == NULL) {
-                newfp_str = new_fp;
-                tail = new_fp;
-            } else {
-                tail->fp_next = new_fp;
-                tail = new_fp;
-            }
-            allocated++;
-        }
-        else
-        { 
-            break; 
-        }
+        fps[allocated].fpn = fpn;
+        if (allocated > 0)
+            fps[allocated - 1].fp_next = &fps[allocated];
+        allocated++;
     }
-    *frm_lst = newfp_str;
-    if (allocated == req_pgnum) {
-        return 0; 
-    } else {
-        return allocated;
+
+    if (allocated == 0)
+    {
+        free(fps);
+        return 0;
     }
+    *frm_lst = fps;
+    return (allocated == req_pgnum) ? 0 : allocated;
 }
 
 /*
@@ -552,19 +692,7 @@ addr_t vm_map_ram(struct pcb_t *caller, addr_t astart, addr_t aend, addr_t mapst
 int __swap_cp_page(struct memphy_struct *mpsrc, addr_t srcfpn,
                    struct memphy_struct *mpdst, addr_t dstfpn)
 {
-  int cellidx;
-  addr_t addrsrc, addrdst;
-  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
-  {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
-
-    BYTE data;
-    MEMPHY_read(mpsrc, addrsrc, &data);
-    MEMPHY_write(mpdst, addrdst, data);
-  }
-
-  return 0;
+  return MEMPHY_copy_page(mpsrc, srcfpn, mpdst, dstfpn);
 }
 
 /*
@@ -580,47 +708,24 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   
   struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
   if (vma0 == NULL) {
-      printf("[ERROR] init_mm: Failed to allocate VMA\n");
+      log_printf("[ERROR] init_mm: Failed to allocate VMA\n");
       return -1;
   }
 
-  /* init page table directory */
-  #ifdef MM64
-      mm->pgd = calloc(PAGING64_PGD_ENTRIES, sizeof(addr_t));
-      mm->p4d = calloc(PAGING64_P4D_ENTRIES, sizeof(addr_t));
-      mm->pud = calloc(PAGING64_PUD_ENTRIES, sizeof(addr_t));
-      mm->pmd = calloc(PAGING64_PMD_ENTRIES, sizeof(addr_t));
-      mm->pt = calloc(PAGING64_PT_ENTRIES, sizeof(addr_t));
-      
-      if (mm->pgd == NULL || mm->p4d == NULL || mm->pud == NULL || mm->pmd == NULL || mm->pt == NULL) {
-          printf("[ERROR] init_mm: Failed to allocate page tables\n");
-          free(vma0);
-          return -1;
-      }
-  #else
-      mm->pgd = calloc(PAGING_MAX_PGN, sizeof(addr_t));
-      mm->p4d = NULL;
-      mm->pud = NULL;
-      mm->pmd = NULL;
-      mm->pt = NULL;
-      
-      if (mm->pgd == NULL) {
-          printf("[ERROR] init_mm: Failed to allocate page table\n");
-          free(vma0);
-          return -1;
-      }
-  #endif
-  
-  // Initialize to zeros
-  #ifdef MM64
-      for (int i = 0; i < PAGING64_PGD_ENTRIES; i++) mm->pgd[i] = 0;
-      for (int i = 0; i < PAGING64_P4D_ENTRIES; i++) mm->p4d[i] = 0;
-      for (int i = 0; i < PAGING64_PUD_ENTRIES; i++) mm->pud[i] = 0;
-      for (int i = 0; i < PAGING64_PMD_ENTRIES; i++) mm->pmd[i] = 0;
-      for (int i = 0; i < PAGING64_PT_ENTRIES; i++) mm->pt[i] = 0;
-  #else
-      for (int i = 0; i < PAGING_MAX_PGN; i++) mm->pgd[i] = 0;
-  #endif
+  /* init page table directory, the lower levels come on demand */
+  mm->pgd = calloc(PAGING64_PGD_ENTRIES, sizeof(pte_t));
+  if (mm->pgd == NULL) {
+      log_printf("[ERROR] init_mm: Failed to allocate page tables\n");
+      free(vma0);
+      return -1;
+  }
+#ifdef MM64_FOLD
+  /* Start out as a lone PT, unfolded as the address space grows */
+  mm->top = 4;
+#else
+  mm->top = 0;
+#endif
+  mm->pgtbl_frames = 0;
 
   /* Initialize VMA */
   vma0->vm_id = 0;
@@ -635,18 +740,38 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
   if (first_rg == NULL) {
-      printf("[ERROR] init_mm: Failed to allocate first region\n");
+      log_printf("[ERROR] init_mm: Failed to allocate first region\n");
       free(vma0);
       return -1;
   }
   
+  vma0->vm_freerg_list = NULL;
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
   vma0->vm_next = NULL;
   vma0->vm_mm = mm; 
 
   mm->mmap = vma0;
-  mm->fifo_pgn = NULL;
+  mm->oncpu = -1;
+  mm->inflight = 0;
+  mm->asid = caller->pid;
+  mm->minflt = 0;
+  mm->majflt = 0;
+  mm->swapout = 0;
+  mm->cowflt = 0;
+  mm->ra_win = 0;
+  mm->ra_prev = 0;
+  mm->ra_recent = 0;
+  mm->ra_pages = 0;
+  mm->ra_hits = 0;
+  mm->ra_wasted = 0;
+#ifdef MM64
+  for (int i = 0; i < MM64_PWC_ENTRIES; i++) {
+    mm->pwc[i].tag = 0;
+    mm->pwc[i].pt = NULL;
+    mm->pwc[i].huge = 0;
+  }
+#endif
   
   // Initialize symbol table
   for (int i = 0; i < PAGING_MAX_SYMTBL_SZ; i++) {
@@ -657,6 +782,90 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   return 0;
 }
 
+/*
+ * free_pgtbl - Return a table of [caller] and everything mapped below it
+ * @dir : table at level [lvl], 0 = PGD .. 4 = PT, the root is not freed
+ *
+ * A data frame still mapped by another process after a fork stays, as
+ * does the shared zero frame while other pages map it.
+ */
+static void free_pgtbl(struct pcb_t *caller, pte_t *dir, int lvl)
+{
+  struct krnl_t *krnl = caller->krnl;
+  pte_t e;
+  addr_t fpn;
+  int i, j;
+
+  for (i = 0; i < PAGING64_PT_ENTRIES; i++) {
+    e = dir[i];
+    if (!PAGING_PTE_PRESENT(e))
+      continue;
+
+    if (lvl == 4) {
+      /* Leaf, the data page lives in RAM or in swap */
+      if (PAGING_PTE_SWAPPED(e)) {
+#ifdef MM_ZSWAP
+        if (PAGING_PTE_SWPTYP(e) == PAGING_SWPTYP_ZSWAP)
+          zswap_invalidate(PAGING_PTE_SWP(e));
+        else
+#endif
+        swapdev_put_slot(PAGING_PTE_SWPTYP(e), PAGING_PTE_SWP(e));
+      } else if (MEMPHY_is_zerofp(krnl->mram, PAGING_PTE_FPN(e))) {
+        MEMPHY_put_zerofp(krnl->mram);
+      } else if (reclaim_unmap(PAGING_PTE_FPN(e), caller) == 0) {
+        MEMPHY_put_freefp(krnl->mram, PAGING_PTE_FPN(e));
+      }
+      continue;
+    }
+
+    fpn = PAGING_PTE_FPN(e);
+    if (lvl == 3 && (e & PAGING_PTE_HUGE_MASK)) {
+      for (j = 0; j < PAGING64_PT_ENTRIES; j++)
+        MEMPHY_put_freefp(krnl->mram, fpn + j);
+      continue;
+    }
+
+    free_pgtbl(caller, (pte_t *)(krnl->mram->storage + fpn * PAGING_PAGESZ), lvl + 1);
+    MEMPHY_put_freefp(krnl->mram, fpn);
+  }
+}
+
+/*
+ * free_mm - Tear an address space down when its owner exits
+ * @mm:     self mm
+ * @caller: mm owner
+ *
+ * Every data, swap and page table frame goes back to its MEMPHY and all
+ * host side metadata is released, the mm itself included.
+ */
+int free_mm(struct mm_struct *mm, struct pcb_t *caller)
+{
+  struct vm_area_struct *vma, *nvma;
+  struct vm_rg_struct *rg, *nrg;
+
+  if (mm == NULL)
+    return -1;
+
+  free_pgtbl(caller, mm->pgd, mm->top);
+#ifdef MM_TLB
+  tlb_flush_asid(mm->asid);
+#endif
+
+  for (vma = mm->mmap; vma != NULL; vma = nvma) {
+    nvma = vma->vm_next;
+    for (rg = vma->vm_freerg_list; rg != NULL; rg = nrg) {
+      nrg = rg->rg_next;
+      free(rg);
+    }
+    free(vma);
+  }
+
+  free(mm->pgd);
+  free(mm);
+
+  return 0;
+}
+
 struct vm_rg_struct *init_vm_rg(addr_t rg_start, addr_t rg_end)
 {
   struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
@@ -691,15 +900,15 @@ int print_list_fp(struct framephy_struct *ifp)
 {
   struct framephy_struct *fp = ifp;
 
-  printf("print_list_fp: ");
-  if (fp == NULL) { printf("NULL list\n"); return -1;}
-  printf("\n");
+  log_printf("print_list_fp: ");
+  if (fp == NULL) { log_printf("NULL list\n"); return -1;}
+  log_printf("\n");
   while (fp != NULL)
   {
-    printf("fp[" FORMAT_ADDR "]\n", fp->fpn);
+    log_printf("fp[" FORMAT_ADDR "]\n", fp->fpn);
     fp = fp->fp_next;
   }
-  printf("\n");
+  log_printf("\n");
   return 0;
 }
 
@@ -707,15 +916,15 @@ int print_list_rg(struct vm_rg_struct *irg)
 {
   struct vm_rg_struct *rg = irg;
 
-  printf("print_list_rg: ");
-  if (rg == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  log_printf("print_list_rg: ");
+  if (rg == NULL) { log_printf("NULL list\n"); return -1; }
+  log_printf("\n");
   while (rg != NULL)
   {
-    printf("rg[" FORMAT_ADDR "->"  FORMAT_ADDR "]\n", rg->rg_start, rg->rg_end);
+    log_printf("rg[" FORMAT_ADDR "->"  FORMAT_ADDR "]\n", rg->rg_start, rg->rg_end);
     rg = rg->rg_next;
   }
-  printf("\n");
+  log_printf("\n");
   return 0;
 }
 
@@ -723,44 +932,56 @@ int print_list_vma(struct vm_area_struct *ivma)
 {
   struct vm_area_struct *vma = ivma;
 
-  printf("print_list_vma: ");
-  if (vma == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  log_printf("print_list_vma: ");
+  if (vma == NULL) { log_printf("NULL list\n"); return -1; }
+  log_printf("\n");
   while (vma != NULL)
   {
-    printf("va[" FORMAT_ADDR "->" FORMAT_ADDR "]\n", vma->vm_start, vma->vm_end);
+    log_printf("va[" FORMAT_ADDR "->" FORMAT_ADDR "]\n", vma->vm_start, vma->vm_end);
     vma = vma->vm_next;
   }
-  printf("\n");
+  log_printf("\n");
   return 0;
 }
 
 int print_list_pgn(struct pgn_t *ip)
 {
-  printf("print_list_pgn: ");
-  if (ip == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  log_printf("print_list_pgn: ");
+  if (ip == NULL) { log_printf("NULL list\n"); return -1; }
+  log_printf("\n");
   while (ip != NULL)
   {
-    printf("va[" FORMAT_ADDR "]-\n", ip->pgn);
+    log_printf("va[" FORMAT_ADDR "]-\n", ip->pgn);
     ip = ip->pg_next;
   }
-  printf("n");
+  log_printf("n");
   return 0;
 }
 
 int print_pgtbl(struct pcb_t *caller, addr_t start, addr_t end)
 {
   if (caller->krnl && caller->krnl->mm) {
-    printf("print_pgtbl:\n PDG=%lx P4g=%lx PUD=%lx PMD=%lx\n", 
+    log_printf("print_pgtbl:\n PDG=%lx levels=%d table frames=%d\n",
            (addr_t)caller->krnl->mm->pgd,
-           (addr_t)caller->krnl->mm->p4d, 
-           (addr_t)caller->krnl->mm->pud,
-           (addr_t)caller->krnl->mm->pmd);
+           5 - caller->krnl->mm->top,
+           caller->krnl->mm->pgtbl_frames);
   }
   return 0;
 }
 
+/*
+ * pgtbl_footprint - Memory an address space spends on paging structures
+ * @mm     : address space
+ * @frames : set to the RAM frames holding its tables
+ *
+ * Returns the host bytes of the mm and its root table.
+ */
+addr_t pgtbl_footprint(struct mm_struct *mm, int *frames)
+{
+  *frames = mm->pgtbl_frames;
+  return sizeof(struct mm_struct) + PAGING64_PGD_ENTRIES * sizeof(pte_t);
+}
+
 addr_t *fpn_to_ptr(struct memphy_struct *mp, addr_t fpn) {
     if (mp == NULL || mp->storage == NULL) return NULL;
     if (fpn * PAGING_PAGESZ >= mp->maxsz) return NULL;
@@ -4,6 +4,13 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "libmem.h"
+#include "log.h"
+#include "trace.h"
+#include "tlb.h"
+#include "reclaim.h"
+#include "zswap.h"
+#include "swapdev.h"
 
 #include <pthread.h>
 #include <stdio.h>
@@ -19,6 +26,7 @@ static int done = 0;
 #ifdef MM_PAGING
 static int memramsz;
 static int memswpsz[PAGING_MAX_MMSWP];
+static int memswpprio[PAGING_MAX_MMSWP];
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -31,11 +39,20 @@ struct mmpaging_ld_args {
 };
 #endif
 
+#define LD_PATH_MAX 256
+
+/*
+ * Arrivals are streamed from the config file one at a time, the loader
+ * only keeps the next pending process so memory stays bounded no matter
+ * how many processes the config describes.
+ */
 static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
+	FILE * file;
+	int remain;		/* arrivals not yet read from file */
+	char path[sizeof(DEFAULT_PROC_PATH) + LD_PATH_MAX];
+	unsigned long start_time;
 #ifdef MLQ_SCHED
-	unsigned long * prio;
+	unsigned long prio;
 #endif
 } ld_processes;
 int num_processes;
@@ -49,6 +66,7 @@ struct cpu_args {
 static void * cpu_routine(void * args) {
 	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
 	int id = ((struct cpu_args*)args)->id;
+	cpu_id = id;
 	/* Check for new process in ready queue */
 	int time_left = 0;
 	struct pcb_t * proc = NULL;
@@ -58,21 +76,29 @@ static void * cpu_routine(void * args) {
 			/* No process is running, the we load new process from
 		 	* ready queue */
 			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
+			/* First load failed, the recheck below decides
+			 * between skipping the slot and stopping */
 		}else if (proc->pc == proc->code->size) {
 			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
+			log_printf("\tCPU %d: Processed %2d has finished\n",
 				id ,proc->pid);
-			free(proc);
+			TRACE(TRACE_FINISH, proc->pid, 0, 0);
+			finish_proc(proc);
+#ifdef MM_PAGING
+			libexit(proc);
+#endif
+			free(proc->krnl);
+			unload(proc);
 			proc = get_proc();
 			time_left = 0;
 		}else if (time_left == 0) {
 			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
+			log_printf("\tCPU %d: Put process %2d to run queue\n",
 				id, proc->pid);
+			TRACE(TRACE_PREEMPT, proc->pid, 0, 0);
+#ifdef MM_PAGING
+			libswitch(proc, -1);
+#endif
 			put_proc(proc);
 			proc = get_proc();
 		}
@@ -80,7 +106,7 @@ static void * cpu_routine(void * args) {
 		/* Recheck process status after loading new process */
 		if (proc == NULL && done) {
 			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
+			log_printf("\tCPU %d stopped\n", id);
 			break;
 		}else if (proc == NULL) {
 			/* There may be new processes to run in
@@ -88,8 +114,12 @@ static void * cpu_routine(void * args) {
 			next_slot(timer_id);
 			continue;
 		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
+			log_printf("\tCPU %d: Dispatched process %2d\n",
 				id, proc->pid);
+			TRACE(TRACE_DISPATCH, proc->pid, 0, 0);
+#ifdef MM_PAGING
+			libswitch(proc, id);
+#endif
 			time_left = time_slot;
 		}
 		usleep(000);
@@ -102,6 +132,8 @@ static void * cpu_routine(void * args) {
 	pthread_exit(NULL);
 }
 
+static int ld_next_process(void);
+
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
@@ -111,17 +143,20 @@ static void * ld_routine(void * args) {
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
-	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
+	log_printf("ld_routine\n");
+	while (ld_next_process() == 0) {
+		struct pcb_t * proc = load(ld_processes.path);
 		//struct krnl_t * krnl = proc->krnl = &os;	
 		proc->krnl = malloc(sizeof(struct krnl_t));
 		struct krnl_t * krnl = proc->krnl;
 #ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
+		proc->prio = ld_processes.prio;
 #endif
-		while (current_time() < ld_processes.start_time[i]) {
+		while (current_time() < ld_processes.start_time) {
+			next_slot(timer_id);
+		}
+		/* Hold the arrival back while its ready queue is full */
+		while (!can_add_proc(proc)) {
 			next_slot(timer_id);
 		}
 		usleep(1000);
@@ -132,95 +167,173 @@ static void * ld_routine(void * args) {
 		krnl->mswp = mswp;
 		krnl->active_mswp = active_mswp;
 #endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+		log_printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+			ld_processes.path, proc->pid, ld_processes.prio);
+		TRACE(TRACE_LOAD, proc->pid, ld_processes.prio, 0);
 		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
 		next_slot(timer_id);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
+	fclose(ld_processes.file);
 	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/*
+ * ld_next_process - read the next arrival of the config file
+ * Return 0 and fill ld_processes if there is one, -1 otherwise.
+ */
+static int ld_next_process(void) {
+	char line[LD_PATH_MAX];
+	char proc[LD_PATH_MAX];
+
+	while (ld_processes.remain > 0 &&
+	       fgets(line, sizeof(line), ld_processes.file) != NULL) {
+#ifdef MLQ_SCHED
+		ld_processes.prio = 0;
+		if (sscanf(line, "%lu %255s %lu", &ld_processes.start_time,
+				proc, &ld_processes.prio) < 2)
+			continue;
+#else
+		if (sscanf(line, "%lu %255s", &ld_processes.start_time,
+				proc) < 2)
+			continue;
+#endif
+		ld_processes.remain--;
+#ifdef MLQ_SCHED
+		/* It would never be admitted, the loader would wait on it forever */
+		if (ld_processes.prio >= MAX_PRIO) {
+			log_printf("\tSkipped %s: PRIO %lu is not below %d\n",
+				proc, ld_processes.prio, MAX_PRIO);
+			continue;
+		}
+#endif
+		snprintf(ld_processes.path, sizeof(ld_processes.path),
+			"%s%s", DEFAULT_PROC_PATH, proc);
+		return 0;
+	}
+
+	return -1;
+}
+
+#ifdef MM_PAGING
+/*
+ * parse_mem_line - read "RAM SWP0[:PRIO] .. SWPn[:PRIO]" into [ramsz],
+ * memswpsz and memswpprio, -1 when the line is not of that form
+ */
+static int parse_mem_line(const char *line, int *ramsz) {
+	int sz[PAGING_MAX_MMSWP] = { 0 }, prio[PAGING_MAX_MMSWP] = { 0 };
+	const char *p = line;
+	char *end;
+	int sit, ram;
+
+	ram = strtol(p, &end, 10);
+	if (end == p)
+		return -1;
+	for (sit = 0, p = end; sit < PAGING_MAX_MMSWP; sit++, p = end) {
+		sz[sit] = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		if (*end == ':')
+			prio[sit] = strtol(end + 1, &end, 10);
+	}
+	if (sit == 0)
+		return -1;
+
+	*ramsz = ram;
+	memcpy(memswpsz, sz, sizeof(sz));
+	memcpy(memswpprio, prio, sizeof(prio));
+	return 0;
+}
+#endif
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find configure file at %s\n", path);
+		log_printf("Cannot find configure file at %s\n", path);
 		exit(1);
 	}
 	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
 		
 #ifdef MM_PAGING
-	int sit;
+	char line[LD_PATH_MAX];
+	long current_pos = ftell(file);
+	int ramsz;
 
-#ifdef MM_FIXED_MEMSZ
-	/* Fixed memory mode - dùng giá trị mặc định */
+	/* Defaults when the config has no memory line */
 	memramsz    =  0x100000;     // 1MB
 	memswpsz[0] = 0x1000000;    // 16MB
-	for(sit = 1; sit < PAGING_MAX_MMSWP; sit++)
-		memswpsz[sit] = 0;
-	long current_pos = ftell(file);
-	int first_num, second_num;
-	
-	if (fscanf(file, "%d %d", &first_num, &second_num) == 2) {
 
-		// Đọc đến hết dòng
-		int ch;
-		while ((ch = fgetc(file)) != '\n' && ch != EOF);
-	} else {
+	if (fgets(line, sizeof(line), file) == NULL ||
+	    parse_mem_line(line, &ramsz) != 0) {
 		// Không phải memory sizes, quay lại vị trí cũ
 		fseek(file, current_pos, SEEK_SET);
 	}
-#else
-	/* Dynamic memory mode - đọc từ input file */
-	fscanf(file, "%d\n", &memramsz);
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
-	fscanf(file, "\n");
+#ifndef MM_FIXED_MEMSZ
+	/* Dynamic memory mode - RAM size from the input file too */
+	else
+		memramsz = ramsz;
 #endif
 #endif
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
+	/* Process arrivals are left in the file for the loader to stream */
+	ld_processes.file = file;
+	ld_processes.remain = num_processes;
+}
 
-	int i;
-	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
-#endif
-		strcat(ld_processes.path[i], proc);
-	}
-	
-	fclose(file);
+static void usage(void) {
+	printf("Usage: os [-t trace file] [-r fifo|clock|2q|ws] [-k ksm pages per scan] "
+	       "[-m|-M device file dir] [path to configure file]\n");
 }
 
 int main(int argc, char * argv[]) {
+	char * trace_path = NULL;
+	char * memdir = NULL;	/* back the devices by files in here */
+	int memkeep = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:r:k:m:M:")) != -1) {
+		switch (opt) {
+		case 't':
+			trace_path = optarg;
+			break;
+		case 'M':
+			/* As -m, the files stay for inspection */
+			memkeep = 1;
+			/* fall through */
+		case 'm':
+			memdir = optarg;
+			break;
+		case 'r':
+			if (reclaim_set_policy(optarg) != 0) {
+				usage();
+				return 1;
+			}
+			break;
+#if defined(MM64) && defined(MM_KSM)
+		case 'k':
+			/* 0 keeps ksmd from starting */
+			ksm_pages_to_scan = atoi(optarg);
+			break;
+#endif
+		default:
+			usage();
+			return 1;
+		}
+	}
+
 	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	if (optind != argc - 1) {
+		usage();
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
+	char path[LD_PATH_MAX];
+	snprintf(path, sizeof(path), "input/%s", argv[optind]);
 	read_config(path);
 
+	if (trace_path != NULL && trace_start(trace_path) != 0)
+		return 1;
+
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
 		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
@@ -233,6 +346,10 @@ int main(int argc, char * argv[]) {
 		args[i].id = i;
 	}
 	struct timer_id_t * ld_event = attach_event();
+#ifdef LOG_ASYNC
+	/* Every thread logs into its own ring from here on */
+	log_start();
+#endif
 	start_timer();
 
 #ifdef MM_PAGING
@@ -243,25 +360,61 @@ int main(int argc, char * argv[]) {
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
 
 	/* Create MEM RAM */
-	init_memphy(&mram, memramsz, rdmflag);
+	char devpath[LD_PATH_MAX];
+	if (memdir == NULL) {
+		init_memphy(&mram, memramsz, rdmflag);
+	} else {
+		snprintf(devpath, sizeof(devpath), "%s/ram", memdir);
+		if (init_memphy_file(&mram, memramsz, rdmflag, devpath, memkeep) != 0) {
+			perror(devpath);
+			return 1;
+		}
+	}
+	reclaim_init(mram.maxsz / PAGING_PAGESZ);
+#ifdef MM_ZSWAP
+	zswap_init(mram.maxsz / 100 * PAGING_ZSWAP_PERCENT);
+#endif
 
         /* Create all MEM SWAP */ 
+	struct memphy_struct *mswp_tbl[PAGING_MAX_MMSWP];
 	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+	       mswp_tbl[sit] = &mswp[sit];
+	       if (memdir == NULL) {
+		       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+		       continue;
+	       }
+	       snprintf(devpath, sizeof(devpath), "%s/swap%d", memdir, sit);
+	       if (init_memphy_file(&mswp[sit], memswpsz[sit], rdmflag, devpath,
+				    memkeep) != 0) {
+		       perror(devpath);
+		       return 1;
+	       }
+	}
+	swapdev_init(mswp, memswpprio, PAGING_MAX_MMSWP);
+#ifdef MM_KSWAPD
+	kswapd_start(&mram);
+#endif
+#if defined(MM64) && defined(MM_KSM)
+	if (ksm_pages_to_scan > 0)
+		ksm_start(&mram);
+#endif
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
 
 	mm_ld_args->timer_id = ld_event;
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
-	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
+	mm_ld_args->mswp = mswp_tbl;
 	mm_ld_args->active_mswp = (struct memphy_struct *) &mswp[0];
         mm_ld_args->active_mswp_id = 0;
 #endif
 
 	/* Init scheduler */
 	init_scheduler();
+#ifdef MM_TLB
+	tlb_init(num_cpus);
+#endif
 
 	for (i = 0; i < num_cpus; i++) {
         pthread_create(&cpu[i], NULL,
@@ -287,6 +440,37 @@ int main(int argc, char * argv[]) {
 
 	/* Stop timer */
 	stop_timer();
+#ifdef MM_PAGING
+	/* The kernel threads record events too, they go before the trace */
+#ifdef MM_KSWAPD
+	kswapd_stop();
+#endif
+#if defined(MM64) && defined(MM_KSM)
+	ksm_stop();
+#endif
+#endif
+	trace_stop();
+#ifdef MM_TLB
+	tlb_report();
+#endif
+#ifdef MM_PAGING
+	pg_fault_report();
+	reclaim_report();
+#ifdef MM_ZSWAP
+	zswap_report();
+#endif
+	swapdev_report();
+	/* Every process has exited, so should every frame be free */
+	log_printf("RAM: %d of %d frames free\n", MEMPHY_count_freefp(&mram),
+		mram.maxsz / PAGING_PAGESZ);
+	free_memphy(&mram);
+	for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+		free_memphy(&mswp[sit]);
+#endif
+
+#ifdef LOG_ASYNC
+	log_stop();
+#endif
 
 	return 0;
 
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "queue.h"
+#include "log.h"
 
 int empty(struct queue_t *q)
 {
@@ -15,7 +16,7 @@ void enqueue(struct queue_t *q, struct pcb_t *proc)
         if(q==NULL || proc == NULL) return;
         
         if(q->size >= MAX_QUEUE_SIZE){
-          printf("Queue is full, Cannot enqueue %d\n", proc->pid);
+          log_printf("Queue is full, Cannot enqueue %d\n", proc->pid);
           return;
         }
         
@@ -89,14 +89,14 @@ struct pcb_t *get_mlq_proc(void) {
 void put_mlq_proc(struct pcb_t * proc) {
     if (proc == NULL) return;
     
-    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&mlq_lock);
     purgequeue(&running_list, proc);
     
     if (proc->prio >= 0 && proc->prio < MAX_PRIO) {
         enqueue(&mlq_ready_queue[proc->prio], proc);
     }
     
-    pthread_mutex_unlock(&queue_lock);
+    pthread_mutex_unlock(&mlq_lock);
 }
 
 void add_mlq_proc(struct pcb_t * proc) {
@@ -108,13 +108,38 @@ void add_mlq_proc(struct pcb_t * proc) {
 	 *       It worth to protect by a mechanism.
 	 * 
 	 */
-    pthread_mutex_lock(&queue_lock);
+    pthread_mutex_lock(&mlq_lock);
     
     if (proc->prio >= 0 && proc->prio < MAX_PRIO) {
         enqueue(&mlq_ready_queue[proc->prio], proc);
     }
     
-    pthread_mutex_unlock(&queue_lock);   	
+    pthread_mutex_unlock(&mlq_lock);   	
+}
+
+/* A finished process leaves the running list for good */
+void finish_mlq_proc(struct pcb_t * proc) {
+    pthread_mutex_lock(&mlq_lock);
+    purgequeue(&running_list, proc);
+    pthread_mutex_unlock(&mlq_lock);
+}
+
+int can_add_proc(struct pcb_t * proc) {
+    int ret, i, queued;
+
+    if (proc->prio >= MAX_PRIO)
+        return 0;
+
+    /* Running processes of this priority come back to the same queue
+     * when preempted, keep room for them */
+    pthread_mutex_lock(&mlq_lock);
+    queued = mlq_ready_queue[proc->prio].size;
+    for (i = 0; i < running_list.size; i++)
+        if (running_list.proc[i]->prio == proc->prio)
+            queued++;
+    ret = (queued < MAX_QUEUE_SIZE);
+    pthread_mutex_unlock(&mlq_lock);
+    return ret;
 }
 
 struct pcb_t * get_proc(void) {
@@ -128,6 +153,10 @@ void put_proc(struct pcb_t * proc) {
 void add_proc(struct pcb_t * proc) {
 	return add_mlq_proc(proc);
 }
+
+void finish_proc(struct pcb_t * proc) {
+	return finish_mlq_proc(proc);
+}
 #else
 struct pcb_t * get_proc(void) {
 	struct pcb_t * proc = NULL;
@@ -177,6 +206,21 @@ void add_proc(struct pcb_t * proc) {
 	enqueue(&ready_queue, proc);
 	pthread_mutex_unlock(&queue_lock);	
 }
+
+void finish_proc(struct pcb_t * proc) {
+	pthread_mutex_lock(&queue_lock);
+	purgequeue(&running_list, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+int can_add_proc(struct pcb_t * proc) {
+	int ret;
+
+	pthread_mutex_lock(&queue_lock);
+	ret = (ready_queue.size < MAX_QUEUE_SIZE);
+	pthread_mutex_unlock(&queue_lock);
+	return ret;
+}
 void finish_scheduler(void) {
     pthread_mutex_destroy(&queue_lock);
 }
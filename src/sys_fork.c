@@ -0,0 +1,64 @@
+/*
+ * System Call: fork
+ * SYSCALL: fork - clone the calling process, its memory copy-on-write
+ *
+ * The child is a copy of the caller that goes on from the instruction
+ * after the syscall. Register [a1] receives the pid of the child in the
+ * parent and 0 in the child, so a jnz on it tells them apart. A failed
+ * fork leaves -1 in the parent's register.
+ */
+
+#include "syscall.h"
+#include "common.h"
+#include "queue.h"
+#include "loader.h"
+#include "sched.h"
+#include "libmem.h"
+#include "log.h"
+#include "trace.h"
+#include <stdlib.h>
+
+int __sys_fork(struct krnl_t *krnl, uint32_t pid, struct sc_regs *regs)
+{
+    struct pcb_t *caller = NULL, *child;
+    uint32_t reg = regs->a1;
+    int i;
+
+    for (i = 0; i < krnl->running_list->size; i++) {
+        if (krnl->running_list->proc[i]->pid == pid) {
+            caller = krnl->running_list->proc[i];
+            break;
+        }
+    }
+    if (caller == NULL || reg >= sizeof(caller->regs) / sizeof(caller->regs[0]))
+        return -1;
+    caller->regs[reg] = (addr_t)-1;
+
+    child = dup_proc(caller);
+    if (!can_add_proc(child)) {
+        unload(child);
+        return -1;
+    }
+
+    child->krnl = malloc(sizeof(struct krnl_t));
+    *child->krnl = *caller->krnl;
+    child->krnl->mm = NULL;
+    if (libfork(caller, child) != 0) {
+        log_printf("\tFork of process %d failed, out of memory\n", pid);
+        free(child->krnl);
+        unload(child);
+        return -1;
+    }
+
+    caller->regs[reg] = child->pid;
+    child->regs[reg] = 0;
+
+    log_printf("\tForked process %d from %d\n", child->pid, pid);
+#ifdef MLQ_SCHED
+    TRACE(TRACE_LOAD, child->pid, child->prio, 0);
+#else
+    TRACE(TRACE_LOAD, child->pid, 0, 0);
+#endif
+    add_proc(child);
+    return 0;
+}
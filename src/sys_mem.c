@@ -8,10 +8,11 @@
  * for the sole purpose of studying while attending the course CO2018.
  */
 
-#include "os-mm.h"
+#include "common.h"
 #include "syscall.h"
 #include "libmem.h"
 #include "queue.h"
+#include "log.h"
 #include <stdlib.h>
 
 #ifdef MM64
@@ -85,7 +86,7 @@ int __sys_memmap(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
             MEMPHY_write(caller->krnl->mram, regs->a2, regs->a3);
             break;
    default:
-            printf("Memop code: %d\n", memop);
+            log_printf("Memop code: %d\n", memop);
             break;
    }
    
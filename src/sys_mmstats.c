@@ -4,11 +4,15 @@
  */
 
 #include "syscall.h"
-#include "os-mm.h"
 #include "common.h"
 #include "queue.h"
+#include "log.h"
 #include <stdio.h>
 
+#ifdef MM64
+#include "mm64.h"
+#endif
+
 // Định nghĩa các macro cơ bản cho paging
 #ifndef PAGING_PTE_PRESENT
 #define PAGING_PTE_PRESENT(pte) ((pte) != 0)
@@ -19,15 +23,15 @@ int __sys_mmstats(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
     // Lấy PID từ parameter thứ nhất (regs->a1)
     uint32_t target_pid = regs->a1;
     
-    printf("[DEBUG] sys_mmstats called by PID %d for target PID: %d\n", pid, target_pid);
+    log_printf("[DEBUG] sys_mmstats called by PID %d for target PID: %d\n", pid, target_pid);
     
     struct pcb_t *caller = NULL;
     
-    printf("[MMSTATS] Looking for process with PID: %d\n", target_pid);
+    log_printf("[MMSTATS] Looking for process with PID: %d\n", target_pid);
     
     // Tìm process bằng target_pid
     if (krnl == NULL || krnl->running_list == NULL) {
-        printf("[MMSTATS] ERROR: Kernel or running_list is NULL\n");
+        log_printf("[MMSTATS] ERROR: Kernel or running_list is NULL\n");
         return -1;
     }
     
@@ -35,53 +39,54 @@ int __sys_mmstats(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
         if (krnl->running_list->proc[i] != NULL && 
             krnl->running_list->proc[i]->pid == target_pid) {
             caller = krnl->running_list->proc[i];
-            printf("[MMSTATS] Found process %d\n", target_pid);
+            log_printf("[MMSTATS] Found process %d\n", target_pid);
             break;
         }
     }
     
     if (caller == NULL) {
-        printf("[MMSTATS] ERROR: Process %d not found in running_list\n", target_pid);
+        log_printf("[MMSTATS] ERROR: Process %d not found in running_list\n", target_pid);
         return -1;
     }
     
     if (caller->krnl == NULL || caller->krnl->mm == NULL) {
-        printf("[MMSTATS] ERROR: Memory management not initialized for process %d\n", target_pid);
+        log_printf("[MMSTATS] ERROR: Memory management not initialized for process %d\n", target_pid);
         return -1;
     }
     
     struct mm_struct *mm = caller->krnl->mm;
     
     // DEBUG CHI TIẾT CẤU TRÚC MEMORY
-    printf("[MMSTATS DEBUG] === MEMORY STRUCTURE DEBUG ===\n");
-    printf("[MMSTATS DEBUG] mm_struct: %p\n", mm);
-    printf("[MMSTATS DEBUG] pgd: %p\n", mm->pgd);
-    printf("[MMSTATS DEBUG] mmap: %p\n", mm->mmap);
+    log_printf("[MMSTATS DEBUG] === MEMORY STRUCTURE DEBUG ===\n");
+    log_printf("[MMSTATS DEBUG] mm_struct: %p\n", mm);
+    log_printf("[MMSTATS DEBUG] pgd: %p\n", mm->pgd);
+    log_printf("[MMSTATS DEBUG] mmap: %p\n", mm->mmap);
     
 #ifdef MM64
-    printf("[MMSTATS DEBUG] 64-bit paging structures:\n");
-    printf("[MMSTATS DEBUG] p4d: %p\n", mm->p4d);
-    printf("[MMSTATS DEBUG] pud: %p\n", mm->pud); 
-    printf("[MMSTATS DEBUG] pmd: %p\n", mm->pmd);
-    printf("[MMSTATS DEBUG] pt: %p\n", mm->pt);
+    log_printf("[MMSTATS DEBUG] 64-bit paging structures:\n");
+    log_printf("[MMSTATS DEBUG] root level: %d of 5\n", 5 - mm->top);
 #endif
 
     // Thống kê memory usage
     int ram_pages = 0;
     int total_pages = 0;
 
-    printf("[MMSTATS] Memory Statistics for PID %d:\n", target_pid);
+    log_printf("[MMSTATS] Memory Statistics for PID %d:\n", target_pid);
     
     // KIỂM TRA CẤU TRÚC PAGE TABLE
     if (mm->pgd == NULL) {
-        printf("[MMSTATS] Page table (pgd) is NULL\n");
+        log_printf("[MMSTATS] Page table (pgd) is NULL\n");
         return 0;
     }
     
-    printf("[MMSTATS] Page table address: %p\n", mm->pgd);
+    log_printf("[MMSTATS] Page table address: %p\n", mm->pgd);
     
     // Đếm pages trong page table - cách đơn giản
+#ifdef MM64
+    int max_entries = PAGING64_PGD_ENTRIES;
+#else
     int max_entries = 1024;
+#endif
     
     for (int i = 0; i < max_entries; i++) {
         if (mm->pgd[i] != 0) { // Page table entry không rỗng
@@ -90,7 +95,7 @@ int __sys_mmstats(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
             
             // In thông tin chi tiết cho một số entries đầu tiên
             if (i < 10) { // Chỉ in 10 entries đầu để tránh spam
-                printf("[MMSTATS] PGD Entry[%d]: 0x%lx -> %s\n", 
+                log_printf("[MMSTATS] PGD Entry[%d]: 0x%lx -> %s\n", 
                        i, mm->pgd[i], 
                        (mm->pgd[i] != 0) ? "VALID" : "INVALID");
             }
@@ -99,32 +104,11 @@ int __sys_mmstats(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
     
     // THỬ ĐẾM PAGES TỪ CÁC LEVEL KHÁC NẾU LÀ 64-BIT
 #ifdef MM64
-    if (mm->p4d != NULL) {
-        printf("[MMSTATS DEBUG] Counting P4D entries...\n");
-        int p4d_count = 0;
-        for (int i = 0; i < 512; i++) {
-            if (mm->p4d[i] != 0) p4d_count++;
-        }
-        printf("[MMSTATS DEBUG] P4D entries used: %d/512\n", p4d_count);
-    }
-    
-    if (mm->pud != NULL) {
-        printf("[MMSTATS DEBUG] Counting PUD entries...\n");
-        int pud_count = 0;
-        for (int i = 0; i < 512; i++) {
-            if (mm->pud[i] != 0) pud_count++;
-        }
-        printf("[MMSTATS DEBUG] PUD entries used: %d/512\n", pud_count);
-    }
-    
-    if (mm->pmd != NULL) {
-        printf("[MMSTATS DEBUG] Counting PMD entries...\n");
-        int pmd_count = 0;
-        for (int i = 0; i < 512; i++) {
-            if (mm->pmd[i] != 0) pmd_count++;
-        }
-        printf("[MMSTATS DEBUG] PMD entries used: %d/512\n", pmd_count);
-    }
+    int tbl_frames;
+    addr_t host_bytes = pgtbl_footprint(mm, &tbl_frames);
+
+    log_printf("[MMSTATS] Page table overhead: %lu host bytes, %d frames (%d bytes)\n",
+           host_bytes, tbl_frames, tbl_frames * PAGING_PAGESZ);
 #endif
     
     // Kiểm tra memory regions từ vm_area_struct
@@ -132,29 +116,35 @@ int __sys_mmstats(struct krnl_t *krnl, uint32_t pid, struct sc_regs* regs)
     struct vm_area_struct *vm_area = mm->mmap;
     while (vm_area != NULL) {
         vm_regions++;
-        printf("[MMSTATS] VM Area %d: 0x%lx - 0x%lx (size: %ld bytes)\n",
+        log_printf("[MMSTATS] VM Area %d: 0x%lx - 0x%lx (size: %ld bytes)\n",
                vm_regions, vm_area->vm_start, vm_area->vm_end,
                vm_area->vm_end - vm_area->vm_start);
         
         // DEBUG THÊM THÔNG TIN VMA
-        printf("[MMSTATS DEBUG] VMA %d: vm_id=%lu, sbrk=0x%lx, vm_mm=%p\n",
+        log_printf("[MMSTATS DEBUG] VMA %d: vm_id=%lu, sbrk=0x%lx, vm_mm=%p\n",
                vm_regions, vm_area->vm_id, vm_area->sbrk, vm_area->vm_mm);
                
         vm_area = vm_area->vm_next;
     }
 
     // Hiển thị statistics
-    printf("[MMSTATS] === MEMORY STATISTICS ===\n");
-    printf("[MMSTATS] Process ID: %d\n", target_pid);
-    printf("[MMSTATS] Total pages allocated: %d\n", total_pages);
-    printf("[MMSTATS] Pages in RAM: %d\n", ram_pages);
-    printf("[MMSTATS] VM Memory regions: %d\n", vm_regions);
+    log_printf("[MMSTATS] === MEMORY STATISTICS ===\n");
+    log_printf("[MMSTATS] Process ID: %d\n", target_pid);
+    log_printf("[MMSTATS] Total pages allocated: %d\n", total_pages);
+    log_printf("[MMSTATS] Pages in RAM: %d\n", ram_pages);
+    log_printf("[MMSTATS] Page faults: %lu minor, %lu major, %lu swapped out, %lu copied on write\n",
+           mm->minflt, mm->majflt, mm->swapout, mm->cowflt);
+#if defined(MM64) && defined(MM_SWAP_RA)
+    log_printf("[MMSTATS] Swap readahead: %lu pages, %lu used, %lu evicted unused\n",
+           mm->ra_pages, mm->ra_hits, mm->ra_wasted);
+#endif
+    log_printf("[MMSTATS] VM Memory regions: %d\n", vm_regions);
     
     if (total_pages > 0) {
-        printf("[MMSTATS] Memory usage: %d pages (%d KB)\n", 
+        log_printf("[MMSTATS] Memory usage: %d pages (%d KB)\n", 
                total_pages, total_pages * 4); // Giả sử page size 4KB
     } else {
-        printf("[MMSTATS] No pages allocated\n");
+        log_printf("[MMSTATS] No pages allocated\n");
     }
     
     // Return số pages trong RAM
@@ -10,6 +10,8 @@
 
 #include "syscall.h"
 #include "common.h"
+#include "log.h"
+#include "trace.h"
 extern int __sys_mmstats(struct krnl_t*, uint32_t, struct sc_regs*);
 #define __SYSCALL(nr, sym) extern int __##sym(struct krnl_t*, uint32_t,struct sc_regs*);
 #include "syscalltbl.lst"
@@ -38,8 +40,9 @@ int __sys_ni_syscall(struct krnl_t *krnl, struct sc_regs *regs)
 #define __SYSCALL(nr, sym) case nr: return __##sym(krnl,pid,regs);
 int syscall(struct krnl_t *krnl, uint32_t pid, uint32_t nr, struct sc_regs* regs)
 {
-    printf("[DEBUG] Syscall %d called by PID %d, params: a1=%d, a2=%d, a3=%d\n", 
+    log_printf("[DEBUG] Syscall %d called by PID %d, params: a1=%d, a2=%d, a3=%d\n", 
            nr, pid, regs->a1, regs->a2, regs->a3);
+    TRACE(TRACE_SYSCALL, pid, nr, 0);
     
     switch (nr) {
     #include "syscalltbl.lst"
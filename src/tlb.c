@@ -0,0 +1,167 @@
+/*
+ * Per-CPU software TLB
+ *
+ * A TLB is only filled and searched by its own CPU thread, the lock is
+ * there for shootdowns coming from the other CPUs and is uncontended
+ * otherwise. Victims are picked by least recent use within the set.
+ */
+
+#include "tlb.h"
+#include "cpu.h"
+#include "log.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+struct tlb_entry {
+	int valid;
+	uint32_t asid;
+	addr_t pgn;
+	pte_t pte;
+	unsigned long used;	/* tick of the last hit or fill */
+};
+
+struct tlb {
+	pthread_mutex_t lock;
+	unsigned long tick;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long shootdowns;	/* entries dropped on request */
+	struct tlb_entry set[TLB_SETS][TLB_WAYS];
+};
+
+static struct tlb *tlbs;
+static int num_tlbs;
+
+static inline int tlb_set_of(uint32_t asid, addr_t pgn)
+{
+	return (pgn ^ (asid * 7)) & (TLB_SETS - 1);
+}
+
+/* TLB of the calling thread, NULL outside the CPU threads */
+static struct tlb *tlb_this_cpu(void)
+{
+	if (cpu_id < 0 || cpu_id >= num_tlbs)
+		return NULL;
+	return &tlbs[cpu_id];
+}
+
+void tlb_init(int ncpus)
+{
+	int i;
+
+	tlbs = calloc(ncpus, sizeof(struct tlb));
+	num_tlbs = ncpus;
+	for (i = 0; i < ncpus; i++)
+		pthread_mutex_init(&tlbs[i].lock, NULL);
+}
+
+int tlb_lookup(uint32_t asid, addr_t pgn, pte_t *pte)
+{
+	struct tlb *tlb = tlb_this_cpu();
+	struct tlb_entry *set;
+	int way;
+
+	if (tlb == NULL)
+		return -1;
+
+	pthread_mutex_lock(&tlb->lock);
+	set = tlb->set[tlb_set_of(asid, pgn)];
+	for (way = 0; way < TLB_WAYS; way++) {
+		if (set[way].valid && set[way].asid == asid &&
+		    set[way].pgn == pgn) {
+			set[way].used = ++tlb->tick;
+			*pte = set[way].pte;
+			tlb->hits++;
+			pthread_mutex_unlock(&tlb->lock);
+			return 0;
+		}
+	}
+	tlb->misses++;
+	pthread_mutex_unlock(&tlb->lock);
+
+	return -1;
+}
+
+void tlb_fill(uint32_t asid, addr_t pgn, pte_t pte)
+{
+	struct tlb *tlb = tlb_this_cpu();
+	struct tlb_entry *set, *victim;
+	int way;
+
+	if (tlb == NULL)
+		return;
+
+	pthread_mutex_lock(&tlb->lock);
+	set = tlb->set[tlb_set_of(asid, pgn)];
+	victim = &set[0];
+	for (way = 0; way < TLB_WAYS; way++) {
+		if (!set[way].valid) {
+			victim = &set[way];
+			break;
+		}
+		if (set[way].used < victim->used)
+			victim = &set[way];
+	}
+	victim->valid = 1;
+	victim->asid = asid;
+	victim->pgn = pgn;
+	victim->pte = pte;
+	victim->used = ++tlb->tick;
+	pthread_mutex_unlock(&tlb->lock);
+}
+
+void tlb_shootdown(uint32_t asid, addr_t pgn)
+{
+	struct tlb_entry *set;
+	int i, way;
+
+	for (i = 0; i < num_tlbs; i++) {
+		pthread_mutex_lock(&tlbs[i].lock);
+		set = tlbs[i].set[tlb_set_of(asid, pgn)];
+		for (way = 0; way < TLB_WAYS; way++) {
+			if (set[way].valid && set[way].asid == asid &&
+			    set[way].pgn == pgn) {
+				set[way].valid = 0;
+				tlbs[i].shootdowns++;
+			}
+		}
+		pthread_mutex_unlock(&tlbs[i].lock);
+	}
+}
+
+void tlb_flush_asid(uint32_t asid)
+{
+	struct tlb_entry *ent;
+	int i, j;
+
+	for (i = 0; i < num_tlbs; i++) {
+		pthread_mutex_lock(&tlbs[i].lock);
+		ent = &tlbs[i].set[0][0];
+		for (j = 0; j < TLB_SETS * TLB_WAYS; j++) {
+			if (ent[j].valid && ent[j].asid == asid) {
+				ent[j].valid = 0;
+				tlbs[i].shootdowns++;
+			}
+		}
+		pthread_mutex_unlock(&tlbs[i].lock);
+	}
+}
+
+void tlb_report(void)
+{
+	unsigned long hits = 0, misses = 0, total;
+	int i;
+
+	log_printf("TLB %d sets x %d ways\n", TLB_SETS, TLB_WAYS);
+	for (i = 0; i < num_tlbs; i++) {
+		total = tlbs[i].hits + tlbs[i].misses;
+		log_printf("\tCPU %d: hits %lu misses %lu shootdowns %lu hit rate %.1f%%\n",
+			i, tlbs[i].hits, tlbs[i].misses, tlbs[i].shootdowns,
+			total ? 100.0 * tlbs[i].hits / total : 0.0);
+		hits += tlbs[i].hits;
+		misses += tlbs[i].misses;
+	}
+	total = hits + misses;
+	log_printf("\tTotal: hits %lu misses %lu hit rate %.1f%%\n",
+		hits, misses, total ? 100.0 * hits / total : 0.0);
+}
@@ -0,0 +1,111 @@
+/*
+ * Binary event trace
+ *
+ * Records are appended to the thread's own buffer without locking, a full
+ * buffer is written out under trace_lock. Records of one thread therefore
+ * reach the file in order, which is all the converter relies on.
+ */
+
+#include "trace.h"
+#include "cpu.h"
+#include "timer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct trace_buf {
+	int used;
+	struct trace_buf *next;
+	struct trace_rec rec[TRACE_BUF_RECS];
+};
+
+int trace_on;
+
+static FILE *trace_file;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buf *bufs;		/* every buffer handed out */
+static __thread struct trace_buf *my_buf;
+static __thread int my_gen;
+static int trace_gen;
+
+static void trace_flush(struct trace_buf *b)
+{
+	if (b->used > 0)
+		fwrite(b->rec, sizeof(struct trace_rec), b->used, trace_file);
+	b->used = 0;
+}
+
+int trace_start(const char *path)
+{
+	struct trace_hdr hdr;
+
+	if (__atomic_load_n(&trace_on, __ATOMIC_ACQUIRE))
+		return -1;
+
+	trace_file = fopen(path, "wb");
+	if (trace_file == NULL) {
+		printf("Cannot create trace file %s\n", path);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.rec_size = sizeof(struct trace_rec);
+	fwrite(&hdr, sizeof(hdr), 1, trace_file);
+
+	__atomic_store_n(&trace_on, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void trace_event(int type, uint32_t pid, uint32_t arg0, uint64_t arg1)
+{
+	struct trace_buf *b = my_buf;
+	struct trace_rec *r;
+
+	if (b == NULL || my_gen != trace_gen) {
+		b = calloc(1, sizeof(struct trace_buf));
+		pthread_mutex_lock(&trace_lock);
+		b->next = bufs;
+		bufs = b;
+		pthread_mutex_unlock(&trace_lock);
+		my_buf = b;
+		my_gen = trace_gen;
+	}
+
+	if (b->used == TRACE_BUF_RECS) {
+		pthread_mutex_lock(&trace_lock);
+		trace_flush(b);
+		pthread_mutex_unlock(&trace_lock);
+	}
+
+	r = &b->rec[b->used++];
+	r->slot = (uint32_t)current_time();
+	r->type = type;
+	r->cpu = cpu_id;
+	r->rsvd = 0;
+	r->pid = pid;
+	r->arg0 = arg0;
+	r->arg1 = arg1;
+}
+
+void trace_stop(void)
+{
+	struct trace_buf *b;
+
+	if (!__atomic_exchange_n(&trace_on, 0, __ATOMIC_ACQ_REL))
+		return;
+
+	pthread_mutex_lock(&trace_lock);
+	while (bufs != NULL) {
+		b = bufs;
+		bufs = b->next;
+		trace_flush(b);
+		free(b);
+	}
+	trace_gen++;
+	fclose(trace_file);
+	trace_file = NULL;
+	pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,181 @@
+/*
+ * trace2json - convert an os -t trace to Chrome trace JSON
+ *
+ *   trace2json trace.bin [out.json]
+ *
+ * The result loads in chrome://tracing and ui.perfetto.dev. CPUs show as
+ * threads of a "CPUs" process with a slice per dispatch, memory events
+ * and syscalls are instants on the CPU they ran on, and every simulated
+ * process gets a lifetime slice under "Processes". One time slot is
+ * drawn as one millisecond.
+ */
+
+#include "trace.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT_US 1000
+#define KERNEL_TID 1000		/* first kernel thread, CPUs come below */
+#define MAX_TIDS (KERNEL_TID + TRACE_NR_KTHREADS)
+
+enum { CPUS_PID = 0, PROCS_PID = 1 };
+
+/* By KERNEL_TID offset, TRACE_CPU_LOADER first */
+static const char *kthread_names[TRACE_NR_KTHREADS] = {
+	"loader", "kswapd", "ksmd"
+};
+
+static const char *type_names[TRACE_NR_TYPES] = {
+	[TRACE_LOAD] = "load",
+	[TRACE_DISPATCH] = "dispatch",
+	[TRACE_PREEMPT] = "preempt",
+	[TRACE_FINISH] = "finish",
+	[TRACE_ALLOC] = "alloc",
+	[TRACE_FREE] = "free",
+	[TRACE_FAULT] = "page fault",
+	[TRACE_SWAPOUT] = "swap out",
+	[TRACE_SWAPIN] = "swap in",
+	[TRACE_SYSCALL] = "syscall",
+};
+
+/* Events of one thread within a slot are spread a microsecond apart */
+static struct {
+	int seen;
+	uint32_t slot;
+	unsigned int step;
+} tids[MAX_TIDS];
+
+static FILE *out;
+static int first = 1;
+
+static void emit(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void emit(const char *fmt, ...)
+{
+	va_list ap;
+
+	fputs(first ? "\n" : ",\n", out);
+	first = 0;
+	va_start(ap, fmt);
+	vfprintf(out, fmt, ap);
+	va_end(ap);
+}
+
+static unsigned long stamp(int tid, uint32_t slot)
+{
+	if (tids[tid].slot != slot) {
+		tids[tid].slot = slot;
+		tids[tid].step = 0;
+	}
+	if (tids[tid].step < SLOT_US - 1)
+		tids[tid].step++;
+	return (unsigned long)slot * SLOT_US + tids[tid].step;
+}
+
+static void convert(const struct trace_rec *r)
+{
+	int tid = (r->cpu >= 0) ? r->cpu : KERNEL_TID - 1 - r->cpu;
+	unsigned long ts;
+
+	if (r->type >= TRACE_NR_TYPES || r->cpu < -TRACE_NR_KTHREADS)
+		return;
+
+	if (!tids[tid].seen) {
+		tids[tid].seen = 1;
+		if (tid >= KERNEL_TID)
+			emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+			     "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			     CPUS_PID, tid, kthread_names[tid - KERNEL_TID]);
+		else
+			emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+			     "\"tid\":%d,\"args\":{\"name\":\"CPU %d\"}}",
+			     CPUS_PID, tid, tid);
+	}
+	ts = stamp(tid, r->slot);
+
+	switch (r->type) {
+	case TRACE_LOAD:
+		emit("{\"name\":\"P%u\",\"ph\":\"B\",\"pid\":%d,\"tid\":%u,"
+		     "\"ts\":%lu,\"args\":{\"prio\":%u}}",
+		     r->pid, PROCS_PID, r->pid, ts, r->arg0);
+		break;
+	case TRACE_DISPATCH:
+		emit("{\"name\":\"P%u\",\"ph\":\"B\",\"pid\":%d,\"tid\":%d,"
+		     "\"ts\":%lu,\"args\":{\"pid\":%u}}",
+		     r->pid, CPUS_PID, tid, ts, r->pid);
+		break;
+	case TRACE_PREEMPT:
+		emit("{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%lu}",
+		     CPUS_PID, tid, ts);
+		break;
+	case TRACE_FINISH:
+		emit("{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%lu}",
+		     CPUS_PID, tid, ts);
+		emit("{\"ph\":\"E\",\"pid\":%d,\"tid\":%u,\"ts\":%lu}",
+		     PROCS_PID, r->pid, ts);
+		break;
+	default:
+		emit("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,"
+		     "\"tid\":%d,\"ts\":%lu,\"args\":{\"pid\":%u,"
+		     "\"arg0\":%u,\"arg1\":%llu}}",
+		     type_names[r->type], CPUS_PID, tid, ts, r->pid,
+		     r->arg0, (unsigned long long)r->arg1);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace_rec recs[TRACE_BUF_RECS];
+	struct trace_hdr hdr;
+	unsigned long total = 0;
+	size_t n, i;
+	FILE *in;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Usage: trace2json trace.bin [out.json]\n");
+		return 1;
+	}
+
+	in = fopen(argv[1], "rb");
+	if (in == NULL) {
+		fprintf(stderr, "Cannot open %s\n", argv[1]);
+		return 1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+	    memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != TRACE_VERSION ||
+	    hdr.rec_size != sizeof(struct trace_rec)) {
+		fprintf(stderr, "%s is not a version %d trace\n",
+			argv[1], TRACE_VERSION);
+		fclose(in);
+		return 1;
+	}
+
+	out = (argc == 3) ? fopen(argv[2], "w") : stdout;
+	if (out == NULL) {
+		fprintf(stderr, "Cannot create %s\n", argv[2]);
+		fclose(in);
+		return 1;
+	}
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", out);
+	emit("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	     "\"args\":{\"name\":\"CPUs\"}}", CPUS_PID);
+	emit("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	     "\"args\":{\"name\":\"Processes\"}}", PROCS_PID);
+
+	while ((n = fread(recs, sizeof(struct trace_rec), TRACE_BUF_RECS, in)) > 0) {
+		for (i = 0; i < n; i++)
+			convert(&recs[i]);
+		total += n;
+	}
+	fputs("\n]}\n", out);
+
+	fclose(in);
+	if (out != stdout)
+		fclose(out);
+	fprintf(stderr, "%lu events\n", total);
+	return 0;
+}
@@ -0,0 +1,487 @@
+/*
+ * Synthetic workload generator
+ *
+ * Emit process programs into input/proc/ and a matching config into
+ * input/ so the scheduler and the paging paths can be exercised at a
+ * scale the hand-written inputs do not reach.
+ *
+ *   wlgen -o NAME [options]
+ *
+ * The generated config is run with "./os NAME".
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define WL_MAX_PRIO	140	/* keep in sync with MAX_PRIO */
+#define WL_NUM_REGS	10	/* keep in sync with pcb_t regs[] */
+#define WL_PAGESZ	4096
+#define WL_PATH_MAX	256
+
+#define DIV_PAGES(sz)	(((unsigned long)(sz) + WL_PAGESZ - 1) / WL_PAGESZ)
+
+enum wl_dist_t {
+	DIST_FIXED,
+	DIST_UNIFORM,
+	DIST_POISSON,
+	DIST_BURST,
+	DIST_EXP,
+	DIST_ZIPF,
+	DIST_SEQ,
+	DIST_RANDOM,
+};
+
+/* A distribution parsed from "kind:arg0:arg1" */
+struct wl_dist {
+	enum wl_dist_t kind;
+	double arg0;
+	double arg1;
+};
+
+enum wl_op_t { OP_CALC, OP_ALLOC, OP_FREE, OP_READ, OP_WRITE, OP_NUM };
+
+static const char *op_name[OP_NUM] = {
+	"calc", "alloc", "free", "read", "write"
+};
+
+static struct wl_cfg {
+	const char *name;
+	const char *dir;
+	int nproc;		/* process arrivals in the config */
+	int nprog;		/* distinct programs shared by the arrivals */
+	int length;		/* instructions per program body */
+	unsigned long loops;	/* body repetitions through loop */
+	int time_slot;
+	int num_cpus;
+	unsigned long ram_sz;
+	unsigned long swp_sz;
+	unsigned int seed;
+	int mix[OP_NUM];
+	struct wl_dist arrival;
+	struct wl_dist prio;
+	struct wl_dist size;
+	struct wl_dist locality;
+} cfg = {
+	.dir = "input",
+	.nproc = 8,
+	.nprog = 0,
+	.length = 32,
+	.loops = 1,
+	.time_slot = 2,
+	.num_cpus = 2,
+	.ram_sz = 1048576,
+	.swp_sz = 16777216,
+	.seed = 1,
+	.mix = { 30, 10, 5, 25, 30 },
+	.arrival = { DIST_UNIFORM, 16, 0 },
+	.prio = { DIST_UNIFORM, 0, WL_MAX_PRIO - 1 },
+	.size = { DIST_UNIFORM, 256, 65536 },
+	.locality = { DIST_SEQ, WL_PAGESZ, 0 },
+};
+
+/* Cumulative zipf weights, cdf[k] = sum(i^-s, i = 1..k) */
+struct wl_zipf {
+	double *cdf;
+	long n;
+};
+
+static struct wl_zipf prio_zipf;
+static struct wl_zipf page_zipf;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s -o NAME [options]\n"
+		"  -o NAME      config input/NAME, programs input/proc/NAME_<i>\n"
+		"  -d DIR       input directory (default input)\n"
+		"  -n COUNT     process arrivals (default 8)\n"
+		"  -P COUNT     distinct programs, 0 = one per arrival\n"
+		"  -l LEN       instructions per program body (default 32)\n"
+		"  -L COUNT     run the body COUNT times through a loop\n"
+		"  -t SLOT      scheduler time slot (default 2)\n"
+		"  -c CPUS      number of CPUs (default 2)\n"
+		"  -m RAM       RAM size in bytes (default 1048576)\n"
+		"  -w SWAP      swap size in bytes (default 16777216)\n"
+		"  -s SEED      random seed (default 1)\n"
+		"  -a DIST      arrivals: uniform:SPAN poisson:RATE burst:SIZE:GAP\n"
+		"  -p DIST      priority: fixed:P uniform:LO:HI zipf:S\n"
+		"  -i MIX       weights calc=N,alloc=N,free=N,read=N,write=N\n"
+		"  -z DIST      alloc size: fixed:N uniform:LO:HI exp:MEAN\n"
+		"  -x DIST      access locality: seq:STRIDE random zipf:S\n",
+		prog);
+	exit(1);
+}
+
+static double urand(void)
+{
+	return (rand() + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+static long irand(long lo, long hi)
+{
+	if (hi <= lo)
+		return lo;
+	return lo + (long)(urand() * (hi - lo + 1));
+}
+
+static int parse_dist(const char *str, struct wl_dist *d)
+{
+	char kind[16];
+	double a0 = 0, a1 = 0;
+	int n = sscanf(str, "%15[^:]:%lf:%lf", kind, &a0, &a1);
+
+	if (n < 1)
+		return -1;
+	d->arg0 = a0;
+	d->arg1 = a1;
+	if (!strcmp(kind, "fixed"))
+		d->kind = DIST_FIXED;
+	else if (!strcmp(kind, "uniform"))
+		d->kind = DIST_UNIFORM;
+	else if (!strcmp(kind, "poisson"))
+		d->kind = DIST_POISSON;
+	else if (!strcmp(kind, "burst"))
+		d->kind = DIST_BURST;
+	else if (!strcmp(kind, "exp"))
+		d->kind = DIST_EXP;
+	else if (!strcmp(kind, "zipf"))
+		d->kind = DIST_ZIPF;
+	else if (!strcmp(kind, "seq"))
+		d->kind = DIST_SEQ;
+	else if (!strcmp(kind, "random"))
+		d->kind = DIST_RANDOM;
+	else
+		return -1;
+
+	if (d->kind == DIST_ZIPF && n < 2)
+		d->arg0 = 1.0;
+	if (d->kind == DIST_SEQ && n < 2)
+		d->arg0 = WL_PAGESZ;
+	return 0;
+}
+
+static int parse_mix(char *str)
+{
+	char *tok;
+	int op;
+
+	memset(cfg.mix, 0, sizeof(cfg.mix));
+	for (tok = strtok(str, ","); tok != NULL; tok = strtok(NULL, ",")) {
+		char *eq = strchr(tok, '=');
+		if (eq == NULL)
+			return -1;
+		*eq = '\0';
+		for (op = 0; op < OP_NUM; op++)
+			if (!strcmp(tok, op_name[op]))
+				break;
+		if (op == OP_NUM)
+			return -1;
+		cfg.mix[op] = atoi(eq + 1);
+	}
+	return 0;
+}
+
+/* zipf rank in [1, n], n is clamped to the table size */
+static long zipf_rank(struct wl_zipf *z, long n)
+{
+	double u;
+	long lo = 1, hi;
+
+	if (n > z->n)
+		n = z->n;
+	u = urand() * z->cdf[n];
+	hi = n;
+	while (lo < hi) {
+		long mid = (lo + hi) / 2;
+		if (z->cdf[mid] < u)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void zipf_init(struct wl_zipf *z, long n, double s)
+{
+	long k;
+
+	z->n = n < 1 ? 1 : n;
+	z->cdf = malloc(sizeof(double) * (z->n + 1));
+	z->cdf[0] = 0;
+	for (k = 1; k <= z->n; k++)
+		z->cdf[k] = z->cdf[k - 1] + pow(k, -s);
+}
+
+static int cmp_arrival(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+
+	return (x > y) - (x < y);
+}
+
+static unsigned long next_arrival(unsigned long now, int idx)
+{
+	switch (cfg.arrival.kind) {
+	case DIST_POISSON:
+		/* exponential inter-arrival gaps with mean 1/RATE slots */
+		if (cfg.arrival.arg0 <= 0)
+			return now;
+		return now + (unsigned long)(-log(urand()) / cfg.arrival.arg0);
+	case DIST_BURST:
+		if (cfg.arrival.arg0 < 1)
+			cfg.arrival.arg0 = 1;
+		return (idx / (int)cfg.arrival.arg0) *
+			(unsigned long)cfg.arrival.arg1;
+	case DIST_FIXED:
+		return (unsigned long)cfg.arrival.arg0;
+	default:
+		return irand(0, (long)cfg.arrival.arg0);
+	}
+}
+
+static unsigned long gen_prio(void)
+{
+	long p;
+
+	switch (cfg.prio.kind) {
+	case DIST_FIXED:
+		p = (long)cfg.prio.arg0;
+		break;
+	case DIST_ZIPF:
+		p = zipf_rank(&prio_zipf, WL_MAX_PRIO) - 1;
+		break;
+	default:
+		p = irand((long)cfg.prio.arg0, (long)cfg.prio.arg1);
+	}
+	if (p < 0)
+		p = 0;
+	if (p >= WL_MAX_PRIO)
+		p = WL_MAX_PRIO - 1;
+	return p;
+}
+
+static unsigned long gen_size(void)
+{
+	long sz;
+
+	switch (cfg.size.kind) {
+	case DIST_FIXED:
+		sz = (long)cfg.size.arg0;
+		break;
+	case DIST_EXP:
+		sz = (long)(-log(urand()) * cfg.size.arg0);
+		break;
+	default:
+		sz = irand((long)cfg.size.arg0, (long)cfg.size.arg1);
+	}
+	return sz < 1 ? 1 : sz;
+}
+
+/* Offset of the next access into a region of [size] bytes */
+static unsigned long gen_offset(unsigned long size, unsigned long *cursor)
+{
+	unsigned long off;
+
+	switch (cfg.locality.kind) {
+	case DIST_RANDOM:
+		return irand(0, size - 1);
+	case DIST_ZIPF:
+		/* hot pages at the start of the region */
+		off = (zipf_rank(&page_zipf, DIV_PAGES(size)) - 1) * WL_PAGESZ +
+			irand(0, WL_PAGESZ - 1);
+		return off < size ? off : size - 1;
+	default:
+		off = *cursor;
+		*cursor = (*cursor + (unsigned long)cfg.locality.arg0) % size;
+		return off;
+	}
+}
+
+static enum wl_op_t pick_op(int total)
+{
+	long r = irand(0, total - 1);
+	int op;
+
+	for (op = 0; op < OP_NUM; op++) {
+		if (r < cfg.mix[op])
+			return op;
+		r -= cfg.mix[op];
+	}
+	return OP_CALC;
+}
+
+/* Read destination, prefer a register not holding a region address */
+static int pick_dest(unsigned long *size)
+{
+	int reg, tries;
+
+	for (tries = 0; tries < 4 * WL_NUM_REGS; tries++) {
+		reg = irand(0, WL_NUM_REGS - 1);
+		if (size[reg] == 0)
+			return reg;
+	}
+	return irand(0, WL_NUM_REGS - 1);
+}
+
+static void gen_program(int id, unsigned long prio)
+{
+	char path[WL_PATH_MAX];
+	unsigned long size[WL_NUM_REGS] = { 0 };
+	unsigned long cursor[WL_NUM_REGS] = { 0 };
+	int total = 0, op, i, reg, nlive = 0, nalloc = 0;
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/proc/%s_%d", cfg.dir, cfg.name, id);
+	if ((file = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	for (op = 0; op < OP_NUM; op++)
+		total += cfg.mix[op];
+
+	/*
+	 * A looped body must be repeatable, so its regions are allocated
+	 * once up front and the body itself only computes and accesses.
+	 */
+	if (cfg.loops > 1) {
+		nalloc = total > 0 ? cfg.length * cfg.mix[OP_ALLOC] / total : 0;
+		if (nalloc < 1)
+			nalloc = 1;
+		if (nalloc > WL_NUM_REGS)
+			nalloc = WL_NUM_REGS;
+	}
+
+	fprintf(file, "%lu %d\n", prio,
+		nalloc + cfg.length + (cfg.loops > 1));
+	for (reg = 0; reg < nalloc; reg++) {
+		size[reg] = gen_size();
+		nlive++;
+		fprintf(file, "alloc %lu %d\n", size[reg], reg);
+	}
+
+	for (i = 0; i < cfg.length; i++) {
+		op = total > 0 ? pick_op(total) : OP_CALC;
+
+		if (cfg.loops > 1 && (op == OP_ALLOC || op == OP_FREE))
+			op = OP_WRITE;
+		/* Memory access needs a live region, allocate one first */
+		if ((op == OP_READ || op == OP_WRITE || op == OP_FREE) &&
+		    nlive == 0)
+			op = OP_ALLOC;
+		if (op == OP_ALLOC && nlive == WL_NUM_REGS)
+			op = OP_WRITE;
+
+		switch (op) {
+		case OP_ALLOC:
+			do {
+				reg = irand(0, WL_NUM_REGS - 1);
+			} while (size[reg] != 0);
+			size[reg] = gen_size();
+			cursor[reg] = 0;
+			nlive++;
+			fprintf(file, "alloc %lu %d\n", size[reg], reg);
+			break;
+		case OP_FREE:
+			do {
+				reg = irand(0, WL_NUM_REGS - 1);
+			} while (size[reg] == 0);
+			size[reg] = 0;
+			nlive--;
+			fprintf(file, "free %d\n", reg);
+			break;
+		case OP_READ:
+		case OP_WRITE:
+			do {
+				reg = irand(0, WL_NUM_REGS - 1);
+			} while (size[reg] == 0);
+			if (op == OP_READ)
+				fprintf(file, "read %d %lu %d\n", reg,
+					gen_offset(size[reg], &cursor[reg]),
+					pick_dest(size));
+			else
+				fprintf(file, "write %ld %d %lu\n",
+					irand(1, 127), reg,
+					gen_offset(size[reg], &cursor[reg]));
+			break;
+		default:
+			fprintf(file, "calc\n");
+		}
+	}
+	if (cfg.loops > 1)
+		fprintf(file, "loop %lu %d\n", cfg.loops, nalloc);
+
+	fclose(file);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[WL_PATH_MAX];
+	unsigned long now = 0, *arrival;
+	FILE *file;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "o:d:n:P:l:L:t:c:m:w:s:a:p:i:z:x:")) != -1) {
+		switch (opt) {
+		case 'o': cfg.name = optarg; break;
+		case 'd': cfg.dir = optarg; break;
+		case 'n': cfg.nproc = atoi(optarg); break;
+		case 'P': cfg.nprog = atoi(optarg); break;
+		case 'l': cfg.length = atoi(optarg); break;
+		case 'L': cfg.loops = strtoul(optarg, NULL, 10); break;
+		case 't': cfg.time_slot = atoi(optarg); break;
+		case 'c': cfg.num_cpus = atoi(optarg); break;
+		case 'm': cfg.ram_sz = strtoul(optarg, NULL, 10); break;
+		case 'w': cfg.swp_sz = strtoul(optarg, NULL, 10); break;
+		case 's': cfg.seed = strtoul(optarg, NULL, 10); break;
+		case 'a': if (parse_dist(optarg, &cfg.arrival)) usage(argv[0]); break;
+		case 'p': if (parse_dist(optarg, &cfg.prio)) usage(argv[0]); break;
+		case 'z': if (parse_dist(optarg, &cfg.size)) usage(argv[0]); break;
+		case 'x': if (parse_dist(optarg, &cfg.locality)) usage(argv[0]); break;
+		case 'i': if (parse_mix(optarg)) usage(argv[0]); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (cfg.name == NULL || cfg.nproc <= 0 || cfg.length <= 0)
+		usage(argv[0]);
+	if (cfg.nprog <= 0 || cfg.nprog > cfg.nproc)
+		cfg.nprog = cfg.nproc;
+
+	srand(cfg.seed);
+	if (cfg.prio.kind == DIST_ZIPF)
+		zipf_init(&prio_zipf, WL_MAX_PRIO, cfg.prio.arg0);
+	/* table covers the largest region the size distribution yields */
+	if (cfg.locality.kind == DIST_ZIPF)
+		zipf_init(&page_zipf, DIV_PAGES(cfg.size.kind == DIST_UNIFORM ?
+			cfg.size.arg1 : 16 * cfg.size.arg0), cfg.locality.arg0);
+
+	for (i = 0; i < cfg.nprog; i++)
+		gen_program(i, gen_prio());
+
+	snprintf(path, sizeof(path), "%s/%s", cfg.dir, cfg.name);
+	if ((file = fopen(path, "w")) == NULL) {
+		perror(path);
+		return 1;
+	}
+	fprintf(file, "%d %d %d\n", cfg.time_slot, cfg.num_cpus, cfg.nproc);
+	fprintf(file, "%lu %lu 0 0 0\n", cfg.ram_sz, cfg.swp_sz);
+	/* The loader expects arrivals in time order */
+	arrival = malloc(sizeof(unsigned long) * cfg.nproc);
+	for (i = 0; i < cfg.nproc; i++) {
+		arrival[i] = next_arrival(now, i);
+		if (cfg.arrival.kind == DIST_POISSON)
+			now = arrival[i];
+	}
+	qsort(arrival, cfg.nproc, sizeof(unsigned long), cmp_arrival);
+	for (i = 0; i < cfg.nproc; i++)
+		fprintf(file, "%lu %s_%d %lu\n", arrival[i], cfg.name,
+			i % cfg.nprog, gen_prio());
+	fclose(file);
+	free(arrival);
+
+	return 0;
+}